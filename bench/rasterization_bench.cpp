@@ -0,0 +1,537 @@
+// Microbenchmark of the hot functions of the core library on random triangle
+// soups of 1k to 10M triangles. --max-triangles <n> stops at a smaller scale.
+// --check runs the correctness checks of the core library instead, the exit
+// code is the number of failed checks
+#include "CommandLog.h"
+#include "Geometry.h"
+#include "Culling.h"
+#include "Helpers.h"
+#include "Selection.h"
+#include "TextImport.h"
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Small triangles spread over the canonical view, like a dense scene
+Eigen::MatrixXf randomSoup(unsigned int triangles, std::mt19937 &random){
+    std::uniform_real_distribution<float> position(-1, 1);
+    std::uniform_real_distribution<float> offset(-1, 1);
+    float size = 2.0f / sqrt(float(triangles));
+    Eigen::MatrixXf V(2, 3*triangles);
+    for(unsigned int t = 0; t < triangles; t++){
+        float x = position(random), y = position(random);
+        for(unsigned int k = 0; k < 3; k++)
+            V.col(3*t+k) << x + size*offset(random), y + size*offset(random);
+    }
+    return V;
+}
+
+// Best time in milliseconds of at least three runs, or as many as fit in a quarter of a second
+// up to maxRuns
+double timeMs(const std::function<void()> &run, unsigned int maxRuns = 1000000){
+    double best = 1e30, total = 0;
+    for(unsigned int i = 0; i < 3 || (total < 250 && i < maxRuns); i++){
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = min(best, ms);
+        total += ms;
+    }
+    return best;
+}
+
+void report(unsigned int triangles, const char *name, double ms){
+    printf("%10u  %-28s %12.3f ms %10.2f ns/triangle\n", triangles, name, ms, 1e6 * ms / triangles);
+}
+
+unsigned int failedChecks = 0;
+
+void check(bool passed, const char *name){
+    printf("%-6s %s\n", passed ? "ok" : "FAILED", name);
+    if(!passed)
+        failedChecks++;
+}
+
+void check(bool passed, const char *name, double worst, double bound){
+    printf("%-6s %-52s worst %.3g, bound %.3g\n", passed ? "ok" : "FAILED", name, worst, bound);
+    if(!passed)
+        failedChecks++;
+}
+
+// Round trip of columns of rows values through a vertex format, packed in the range of data
+// and unpacked as the vertex shader reads them. The largest error must stay within the bound
+// of the documentation, given per value by bound(value, origin, extent)
+void checkPacking(const char *name, VertexFormat format, const vector<float> &data, unsigned int rows,
+                  const std::function<double(float, float, float)> &bound, const vector<float> &moved = vector<float>()){
+    float origin[4], extent[4];
+    unsigned int cols = data.size() / rows;
+    packingRange(format, &data[0], rows, cols, origin, extent);
+
+    // Columns uploaded later keep the range of the whole upload
+    const vector<float> &values = moved.empty() ? data : moved;
+    unsigned int count = values.size() / rows;
+    vector<unsigned char> packed;
+    packColumns(format, &values[0], rows, count, origin, extent, packed);
+    vector<float> unpacked(values.size());
+    unpackColumns(format, packed, rows, count, origin, extent, &unpacked[0]);
+
+    // The error reported is the one closest to its bound
+    bool passed = true;
+    double worst = 0, worstBound = 0, worstRatio = -1;
+    for(unsigned int i = 0; i < values.size(); i++){
+        unsigned int r = i % rows;
+        double error = fabs(double(unpacked[i]) - values[i]);
+        double allowed = bound(values[i], origin[r], extent[r]);
+        double ratio = allowed > 0 ? error / allowed : (error > 0 ? HUGE_VAL : 0);
+        passed = passed && error <= allowed;
+        if(ratio > worstRatio){
+            worst = error;
+            worstBound = allowed;
+            worstRatio = ratio;
+        }
+    }
+    check(passed, name, worst, worstBound);
+}
+
+// Float rounding of the conversions around the packing, relative to the magnitudes involved
+double rounding(double a, double b){
+    return ldexp(fabs(a) + fabs(b), -23);
+}
+
+void checkVertexFormats(std::mt19937 &random){
+    // Positions over a range centered far from zero, as after panning, over the widest range
+    // the half floats hold, and over a small one for the subnormal halves close to the center
+    const float ranges[4][2] = {{-1, 1}, {9997, 10003}, {-65000, 65000}, {0.5f, 0.5001f}};
+    const char *halfNames[4] = {"half float, [-1,1]", "half float, rebased [9997,10003]", "half float, [-65000,65000]", "half float, [0.5,0.5001]"};
+    const char *unormNames[4] = {"unorm16, [-1,1]", "unorm16, [9997,10003]", "unorm16, [-65000,65000]", "unorm16, [0.5,0.5001]"};
+    for(unsigned int k = 0; k < 4; k++){
+        std::uniform_real_distribution<float> position(ranges[k][0], ranges[k][1]);
+        vector<float> data;
+        data.push_back(ranges[k][0]);
+        data.push_back(ranges[k][1]);
+        data.push_back(ranges[k][1]);
+        data.push_back(ranges[k][0]);
+        data.push_back((ranges[k][0] + ranges[k][1]) / 2);
+        data.push_back(nextafterf((ranges[k][0] + ranges[k][1]) / 2, ranges[k][1]));
+        for(unsigned int i = 0; i < 20000; i++)
+            data.push_back(position(random));
+
+        checkPacking(halfNames[k], FORMAT_HALF_FLOAT, data, 2, [](float value, float origin, float){
+            double distance = fabs(double(value) - origin);
+            return ldexp(distance, -11) + ldexp(1.0, -25) + rounding(value, origin);
+        });
+        checkPacking(unormNames[k], FORMAT_UNORM16, data, 2, [](float value, float origin, float extent){
+            return extent / 131070.0 + rounding(value, origin) + rounding(extent, 0);
+        });
+    }
+
+    // A half float range keeps its origin when columns are uploaded later, the
+    // error grows with their distance to it
+    vector<float> data, moved;
+    for(unsigned int i = 0; i < 2000; i++){
+        data.push_back(float(i) / 1000 - 1);
+        moved.push_back(float(i) / 1000 + 500);
+    }
+    checkPacking("half float, columns moved out of the range", FORMAT_HALF_FLOAT, data, 2, [](float value, float origin, float){
+        double distance = fabs(double(value) - origin);
+        return ldexp(distance, -11) + ldexp(1.0, -25) + rounding(value, origin);
+    }, moved);
+
+    // Unorm16 columns outside the range need a whole update
+    float origin[4], extent[4];
+    packingRange(FORMAT_UNORM16, &data[0], 2, data.size() / 2, origin, extent);
+    bool inside = fitsPackingRange(FORMAT_UNORM16, &data[0], 2, data.size() / 2, origin, extent);
+    bool outside = fitsPackingRange(FORMAT_UNORM16, &moved[0], 2, moved.size() / 2, origin, extent);
+    check(inside && !outside, "unorm16, columns out of the range detected");
+
+    // Colors, with the values out of [0,1] clamped
+    std::uniform_real_distribution<float> channel(0, 1);
+    vector<float> colors;
+    const float limits[6] = {0, 1, 0.5f / 255, 1 - 0.5f / 255, 1.0f / 510, 0.5f};
+    colors.insert(colors.end(), limits, limits + 6);
+    for(unsigned int i = 0; i < 30000; i++)
+        colors.push_back(channel(random));
+    checkPacking("unorm8 colors", FORMAT_UNORM8, colors, 3, [](float value, float, float){
+        return 1.0 / 510 + rounding(value, 0);
+    });
+    vector<float> clamped(colors);
+    clamped[0] = -0.25f;
+    clamped[1] = 1.5f;
+    checkPacking("unorm8 colors, clamped to [0,1]", FORMAT_UNORM8, colors, 3, [](float value, float, float){
+        return max(0.0f, -value) + max(0.0f, value - 1) + 1.0 / 510 + rounding(value, 0);
+    }, clamped);
+    checkPacking("float32", FORMAT_FLOAT32, colors, 3, [](float, float, float){ return 0.0; });
+}
+
+// Grid whose stamp can be moved close to the wraparound
+class StampedGrid : public TriangleGrid
+{
+public:
+    void skipStamps(unsigned int stamp){ current_stamp = stamp; }
+};
+
+// Whether query returns, in order, the triangles whose bounds overlap box
+bool sameAsScan(StampedGrid &grid, const BoundingBox &box){
+    vector<unsigned int> found, expected;
+    grid.query(box, found);
+    for(unsigned int t = 0; t < grid.triangle_bounds.size(); t++)
+        if(grid.triangle_bounds[t].overlaps(box))
+            expected.push_back(t);
+    return found == expected;
+}
+
+void checkTriangleGrid(std::mt19937 &random){
+    // Small triangles and a few spanning many cells, which must be reported once
+    Eigen::MatrixXf V = randomSoup(20000, random);
+    for(unsigned int t = 0; t < 20; t++)
+        V.col(3*t+1) = -V.col(3*t);
+    StampedGrid grid;
+    grid.build(V);
+
+    // Boxes of every size, up to past the bounds where the grid is scanned linearly
+    std::uniform_real_distribution<float> center(-1.5f, 1.5f);
+    std::uniform_real_distribution<float> size(-12, 2);
+    bool ok = true;
+    unsigned int scanned = 0;
+    for(unsigned int i = 0; i < 2000; i++){
+        float x = center(random), y = center(random), w = exp2(size(random)), h = exp2(size(random));
+        BoundingBox box;
+        box.extend(x - w, y - h);
+        box.extend(x + w, y + h);
+        int x0, y0, x1, y1;
+        if(grid.cellRange(box, x0, y0, x1, y1) && 2 * (x1 - x0 + 1) * (y1 - y0 + 1) >= grid.cells_x * grid.cells_y)
+            scanned++;
+        ok = ok && sameAsScan(grid, box);
+    }
+    check(ok && scanned > 0 && scanned < 2000, "triangle grid, queries match a scan");
+
+    // Views zoomed far out, whose cell quotients overflow an int, and boxes missing the grid
+    const float far[4][4] = {{-1e30f, -1e30f, 1e30f, 1e30f}, {0.25f, -1e30f, 0.5f, 1e30f}, {-1e20f, 0.5f, -1e19f, 0.75f}, {3, 3, 4, 4}};
+    ok = true;
+    for(unsigned int i = 0; i < 4; i++){
+        BoundingBox box;
+        box.extend(far[i][0], far[i][1]);
+        box.extend(far[i][2], far[i][3]);
+        ok = ok && sameAsScan(grid, box);
+    }
+    check(ok, "triangle grid, boxes far past the bounds");
+
+    // The stamps restart from zero when they wrap around
+    grid.skipStamps(0xfffffffdu);
+    ok = true;
+    for(unsigned int i = 0; i < 4; i++){
+        BoundingBox box;
+        box.extend(-0.1f * i - 0.05f, -0.1f);
+        box.extend(0.1f * i + 0.05f, 0.1f);
+        ok = ok && sameAsScan(grid, box);
+    }
+    check(ok, "triangle grid, stamp wraparound");
+}
+
+void checkRemoveTriangles(std::mt19937 &random){
+    // The deletion of many triangles in one pass matches removing their columns one by one,
+    // with the two columns of a triangle being inserted left at the end
+    Eigen::MatrixXf V = randomSoup(3000, random);
+    V.conservativeResize(Eigen::NoChange, V.cols() + 2);
+    V.rightCols(2).setConstant(7);
+    std::bernoulli_distribution removed(0.3);
+    vector<unsigned int> triangles;
+    for(unsigned int t = 0; t < V.cols() / 3; t++){
+        if(removed(random) || t == 0 || t == V.cols() / 3 - 1)
+            triangles.push_back(t);
+    }
+    Eigen::MatrixXf expected = V;
+    for(unsigned int i = triangles.size(); i-- > 0;){
+        for(unsigned int c = 0; c < 3; c++)
+            removeColumn(expected, 3 * triangles[i]);
+    }
+    removeTriangles(V, triangles);
+    check(V == expected, "triangle removal in one pass");
+}
+
+// Whether the entry holds exactly the given words
+bool sameEntry(const CommandLog::Command &command, CommandLog::Type type, unsigned int index, const uint32_t *data, unsigned int count){
+    return command.type == type && command.index == index && command.count == count && memcmp(command.data, data, count * sizeof(uint32_t)) == 0;
+}
+
+void checkCommandLog(){
+    // Floats are kept bitwise, negative zero and the largest layer included, next to plain words
+    CommandLog log(1 << 20);
+    const float colors[6] = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f};
+    const float layers[2] = {-0.0f, 16777215.0f};
+    uint32_t runs[8];
+    for(unsigned int i = 0; i < 6; i++)
+        runs[i] = CommandLog::fromFloat(i * 0.25f - 1);
+    runs[6] = 0xffffffffu;
+    runs[7] = 7;
+    uint32_t colorWords[6], layerWords[2];
+    memcpy(colorWords, colors, sizeof(colors));
+    memcpy(layerWords, layers, sizeof(layers));
+    log.push(CommandLog::RECOLOR_VERTEX, 5, colors, 6);
+    log.push(CommandLog::TRANSFORM_TRIANGLES, 1, runs, 8);
+    log.push(CommandLog::SET_LAYER, 12, layers, 2);
+
+    CommandLog::Command command;
+    bool ok = log.undo(command) && sameEntry(command, CommandLog::SET_LAYER, 12, layerWords, 2) && command.value(1) == 16777215.0f;
+    ok = ok && log.undo(command) && sameEntry(command, CommandLog::TRANSFORM_TRIANGLES, 1, runs, 8) && command.value(5) == 0.25f;
+    ok = ok && log.undoableEntries() == 1 && log.redoableEntries() == 2;
+    check(ok, "command log, undo in reverse order");
+
+    ok = log.redo(command) && sameEntry(command, CommandLog::TRANSFORM_TRIANGLES, 1, runs, 8);
+    ok = ok && log.redo(command) && sameEntry(command, CommandLog::SET_LAYER, 12, layerWords, 2);
+    ok = ok && !log.redo(command) && log.undoableEntries() == 3;
+    check(ok, "command log, redo in order");
+
+    // A new edit after an undo drops what could be redone
+    log.undo(command);
+    log.undo(command);
+    log.push(CommandLog::CHANGE_OPACITY, 3, colors, 6);
+    ok = log.redoableEntries() == 0 && !log.redo(command) && log.undoableEntries() == 2;
+    ok = ok && log.undo(command) && sameEntry(command, CommandLog::CHANGE_OPACITY, 3, colorWords, 6);
+    ok = ok && log.undo(command) && sameEntry(command, CommandLog::RECOLOR_VERTEX, 5, colorWords, 6) && !log.undo(command);
+    check(ok, "command log, new edit drops the redo entries");
+
+    // Past the budget the oldest entries go, the newest stay in order. Entries of 6 words take 9
+    CommandLog small(100 * sizeof(uint32_t));
+    for(unsigned int i = 0; i < 50; i++)
+        small.push(CommandLog::RECOLOR_VERTEX, i, colors, 6);
+    ok = small.bytes() <= small.budget() && small.undoableEntries() == 100 / 9;
+    for(unsigned int i = 50; ok && i-- > 50 - 100 / 9; )
+        ok = small.undo(command) && sameEntry(command, CommandLog::RECOLOR_VERTEX, i, colorWords, 6);
+    ok = ok && !small.undo(command);
+    check(ok, "command log, budget evicts the oldest entries");
+
+    // The last entry is kept even beyond the budget, a lower budget evicts at once
+    vector<float> large(200, 0.5f);
+    small.push(CommandLog::CHANGE_OPACITY, 0, &large[0], large.size());
+    ok = small.undoableEntries() == 1 && small.undo(command) && command.count == 200 && command.value(199) == 0.5f;
+    small.redo(command);
+    small.push(CommandLog::SET_LAYER, 1, layers, 2);
+    ok = ok && small.undoableEntries() == 1;
+    CommandLog shrunk(1 << 20);
+    for(unsigned int i = 0; i < 20; i++)
+        shrunk.push(CommandLog::RECOLOR_VERTEX, i, colors, 6);
+    shrunk.setBudget(45 * sizeof(uint32_t));
+    ok = ok && shrunk.undoableEntries() == 5 && shrunk.undo(command) && command.index == 19;
+    check(ok, "command log, oversized entries and a lower budget");
+}
+
+// A number in one of the ways text files write them, and its value as strtof reads it
+string formatNumber(float value, std::mt19937 &random, float &parsed){
+    const char *formats[7] = {"%.9g", "%.3f", "%.7e", "%+.4E", "%.0f", "%.22f", "%g"};
+    char text[64];
+    snprintf(text, sizeof(text), formats[random() % 7], value);
+    parsed = strtof(text, NULL);
+    return text;
+}
+
+// Whether the new columns of V and C hold the expected vertices, to a float rounding
+bool sameColumns(const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, unsigned int first, const vector<float> &positions, const vector<float> &colors){
+    if(size_t(V.cols()) != first + positions.size() / 2 || size_t(C.cols()) != first + colors.size() / 3)
+        return false;
+    for(size_t i = 0; i < positions.size(); i++)
+        if(fabs(V(i % 2, first + i / 2) - positions[i]) > ldexp(fabs(positions[i]), -23))
+            return false;
+    for(size_t i = 0; i < colors.size(); i++)
+        if(fabs(C(i % 3, first + i / 3) - colors[i]) > ldexp(fabs(colors[i]), -23))
+            return false;
+    return true;
+}
+
+bool writeText(const char *path, const string &text){
+    FILE *file = fopen(path, "wb");
+    if(!file)
+        return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && ok;
+}
+
+// Files of several chunks of 1 MB, the vertices of the triangles spread over the chunk cuts
+void checkTextImport(std::mt19937 &random){
+    std::uniform_real_distribution<float> position(-1000, 1000);
+    std::uniform_real_distribution<float> channel(0, 1);
+    const Eigen::Vector3f color(0.25f, 0.5f, 0.75f);
+
+    // OBJ: faces with positive, negative and texture or normal references, polygons split into fans
+    string text = "# Exported for the import check\no mesh\n";
+    vector<float> vertices, vertexColors, positions, colors;
+    unsigned int skipped = 0;
+    auto addFace = [&](const vector<unsigned int> &face){
+        for(unsigned int i = 1; i + 1 < face.size(); i++){
+            unsigned int corners[3] = {face[0], face[i], face[i+1]};
+            for(unsigned int k = 0; k < 3; k++){
+                positions.insert(positions.end(), &vertices[2*corners[k]], &vertices[2*corners[k]] + 2);
+                colors.insert(colors.end(), &vertexColors[3*corners[k]], &vertexColors[3*corners[k]] + 3);
+            }
+        }
+    };
+    while(text.size() < (3u << 20) + 12345){
+        unsigned int n = vertices.size() / 2;
+        unsigned int kind = random() % 8;
+        if(kind < 4){
+            // "v x y", "v x y z" or "v x y z r g b", sometimes with a CRLF
+            float x, y, z, rgb[3];
+            text += "v " + formatNumber(position(random), random, x) + " " + formatNumber(position(random), random, y);
+            vertices.push_back(x);
+            vertices.push_back(y);
+            if(kind > 0)
+                text += " " + formatNumber(position(random), random, z);
+            if(kind == 3){
+                for(unsigned int k = 0; k < 3; k++)
+                    text += " " + formatNumber(channel(random), random, rgb[k]);
+                vertexColors.insert(vertexColors.end(), rgb, rgb + 3);
+            } else {
+                vertexColors.insert(vertexColors.end(), color.data(), color.data() + 3);
+            }
+            text += random() % 4 ? "\n" : "\r\n";
+        } else if(kind == 4 && n >= 3){
+            // The last vertices, often read in an earlier chunk
+            text += "f -3 -2 -1\n";
+            addFace(vector<unsigned int>{n - 3, n - 2, n - 1});
+        } else if(kind == 5 && n >= 4){
+            vector<unsigned int> face;
+            text += "f";
+            for(unsigned int k = 0; k < 4; k++){
+                face.push_back(random() % n);
+                const char *suffixes[4] = {"", "/1", "//2", "/3/4"};
+                text += (random() % 2 ? " -" + to_string(n - face.back()) : " " + to_string(face.back() + 1)) + suffixes[k];
+            }
+            text += "\n";
+            addFace(face);
+        } else if(kind == 6){
+            text += "vn 0 0 1\nvt 0.5 0.5\n";
+        } else if(n > 0){
+            // A vertex 0, a vertex past the file or a vertex of text are skipped
+            const char *bad[3] = {"f 0 1 1\n", "f 1 1 99999999\n", "v x y\n"};
+            text += bad[random() % 3];
+            skipped++;
+        }
+    }
+    Eigen::MatrixXf V = randomSoup(1, random), C = Eigen::MatrixXf::Zero(3, 3);
+    Eigen::MatrixXf before = V;
+    ImportStats stats;
+    bool ok = writeText("import_check.obj", text) && importTriangles("import_check.obj", V, C, color, &stats);
+    ok = ok && stats.triangles == positions.size() / 6 && stats.skipped == skipped;
+    ok = ok && V.leftCols(3) == before && sameColumns(V, C, 3, positions, colors);
+    remove("import_check.obj");
+    check(ok, "text import, OBJ over several chunks");
+
+    // CSV: a header, vertex rows of 2, 3 or 5 values and triangle rows of 6 or 15 values with any
+    // separator. The rows that are not numbers and the vertices left over are skipped
+    text = "x,y,r,g,b\n";
+    positions.clear();
+    colors.clear();
+    skipped = 1;
+    const char *separators[4] = {",", ";", " ", "\t"};
+    while(text.size() < (3u << 20) + 777){
+        unsigned int kind = random() % 6;
+        const char *separator = separators[random() % 4];
+        unsigned int values = kind == 0 ? 2 : kind == 1 ? 3 : kind == 2 ? 5 : kind == 3 ? 6 : kind == 4 ? 15 : 4;
+        for(unsigned int i = 0; i < values; i++){
+            float value;
+            bool isColor = (values == 5 && i >= 2) || (values == 15 && i % 5 >= 2);
+            text += (i ? separator : "") + formatNumber(isColor ? channel(random) : position(random), random, value);
+            if(values == 4)
+                continue;
+            if(isColor){
+                colors.push_back(value);
+            } else if(values != 3 || i < 2){
+                positions.push_back(value);
+                if((values == 2 || values == 3 || values == 6) && i % 2 == 1)
+                    colors.insert(colors.end(), color.data(), color.data() + 3);
+            }
+        }
+        skipped += values == 4;
+        text += random() % 8 ? "\n" : "\n\n";
+    }
+    skipped += positions.size() / 2 % 3;
+    positions.resize(positions.size() - positions.size() / 2 % 3 * 2);
+    colors.resize(positions.size() / 2 * 3);
+    V = before;
+    C = Eigen::MatrixXf::Zero(3, 3);
+    ok = writeText("import_check.csv", text) && importTriangles("import_check.csv", V, C, color, &stats);
+    ok = ok && stats.triangles == positions.size() / 6 && stats.skipped == skipped;
+    ok = ok && V.leftCols(3) == before && sameColumns(V, C, 3, positions, colors);
+    remove("import_check.csv");
+    check(ok, "text import, CSV over several chunks");
+}
+
+int runChecks(){
+    std::mt19937 random(42);
+    checkVertexFormats(random);
+    checkCommandLog();
+    checkTriangleGrid(random);
+    checkRemoveTriangles(random);
+    checkTextImport(random);
+    printf("%u checks failed\n", failedChecks);
+    return failedChecks;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int maxTriangles = 10000000;
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if(arg == "--max-triangles" && i+1 < argc)
+            maxTriangles = atoi(argv[++i]);
+        else if(arg == "--check")
+            return runChecks();
+    }
+
+    std::mt19937 random(42);
+    volatile int sink = 0;
+    printf("%10s  %-28s %15s %21s\n", "triangles", "function", "best time", "per triangle");
+    for(unsigned int triangles = 1000; triangles <= maxTriangles; triangles *= 10){
+        Eigen::MatrixXf V = randomSoup(triangles, random);
+
+        // Picking scans every triangle when the point misses them all
+        report(triangles, "pickTriangle (miss)", timeMs([&]() { sink += pickTriangle(V, 2, 2); }));
+        report(triangles, "nearestVertex", timeMs([&]() { sink += nearestVertex(V, 0.5, 0.5); }));
+
+        // Culling: the grid is rebuilt after an edit, then queried for the view
+        TriangleGrid grid;
+        report(triangles, "TriangleGrid::build", timeMs([&]() { grid.build(V); }));
+        BoundingBox view;
+        view.extend(-0.5, -0.5);
+        view.extend(0.5, 0.5);
+        vector<unsigned int> visible;
+        report(triangles, "TriangleGrid::query (1/4)", timeMs([&]() { visible.clear(); grid.query(view, visible); sink += visible.size(); }));
+
+        // Rectangle selection of a quarter of the view and its runs
+        Selection selection;
+        selection.resize(triangles);
+        vector<TriangleRun> runs;
+        report(triangles, "Selection::addBox + runs", timeMs([&]() {
+            selection.clear();
+            selection.addBox(grid, V, view);
+            selection.runs(runs);
+            sink += runs.size();
+        }));
+
+        // Rotation and scale of every triangle, undone by the next run
+        vector<TriangleRun> all(1, TriangleRun(0, triangles));
+        Eigen::Matrix4f transform = rotate(10) * scale(1.25);
+        Eigen::Matrix4f inverse = transform.inverse();
+        bool forward = true;
+        report(triangles, "transformRuns (all)", timeMs([&]() {
+            transformRuns(V, all, forward ? transform : inverse);
+            forward = !forward;
+        }));
+
+        // Deleting the first vertex moves all the others, last as it shrinks V
+        report(triangles, "removeColumn (first)", timeMs([&]() { removeColumn(V, 0); }, 3*triangles/2));
+    }
+    return sink == -1;
+}
@@ -0,0 +1,72 @@
+#include "Antialiasing.h"
+
+#include <iostream>
+
+int MultisampleTarget::maxSamples()
+{
+  GLint samples = 0;
+  glGetIntegerv(GL_MAX_SAMPLES, &samples);
+  return samples;
+}
+
+void MultisampleTarget::resize(int width, int height, int samples)
+{
+  if (framebuffer && width == this->width && height == this->height && samples == this->samples)
+    return;
+  free();
+  this->width = width;
+  this->height = height;
+  this->samples = samples;
+
+  glGenRenderbuffers(1, &color);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  GLint previous;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << samples << "x multisampled targets are not supported" << std::endl;
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+  check_gl_error();
+}
+
+void MultisampleTarget::begin()
+{
+  GLint previous;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  target = previous;
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void MultisampleTarget::resolve()
+{
+  // Only the colors are resolved, the depth of the frame is not needed afterwards
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+}
+
+void MultisampleTarget::free()
+{
+  if (framebuffer)
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    framebuffer = 0;
+    color = 0;
+    depth = 0;
+  }
+  width = 0;
+  height = 0;
+  samples = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ANTIALIASING_H
+#define ANTIALIASING_H
+
+#include "Helpers.h"
+
+// Offscreen framebuffer with multisampled color and depth buffers. The frame
+// is drawn into it between begin() and resolve(), which averages the samples
+// into the framebuffer that was bound before begin()
+class MultisampleTarget
+{
+public:
+  typedef unsigned int GLuint;
+
+  int width;
+  int height;
+  int samples;
+
+  MultisampleTarget() : width(0), height(0), samples(0), framebuffer(0), color(0), depth(0), target(0) {}
+
+  // Largest number of samples supported by the driver
+  static int maxSamples();
+
+  // Allocate the buffers for width x height pixels with the given number of
+  // samples, nothing is done if none of them changed
+  void resize(int width, int height, int samples);
+
+  // Redirect the drawing to the multisampled buffers
+  void begin();
+
+  // Average the samples into the previous framebuffer and bind it again
+  void resolve();
+
+  // Release the buffers
+  void free();
+
+private:
+  GLuint framebuffer;
+  GLuint color;
+  GLuint depth;
+  GLuint target;                 // Framebuffer bound before begin()
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "CommandLog.h"
+
+#include <cstring>
+
+namespace
+{
+  const unsigned int header_words = 2;
+  const unsigned int overhead_words = 3;
+  const unsigned int max_count = 0xffffff;
+
+  uint32_t header(CommandLog::Type type, unsigned int count)
+  {
+    return (uint32_t) type << 24 | count;
+  }
+
+  unsigned int header_count(uint32_t header)
+  {
+    return header & max_count;
+  }
+}
+
+void CommandLog::Command::values(unsigned int first, unsigned int count, float* out) const
+{
+  std::memcpy(out, data + first, count * sizeof(float));
+}
+
+uint32_t CommandLog::fromFloat(float value)
+{
+  uint32_t word;
+  std::memcpy(&word, &value, sizeof(word));
+  return word;
+}
+
+float CommandLog::toFloat(uint32_t word)
+{
+  float value;
+  std::memcpy(&value, &word, sizeof(value));
+  return value;
+}
+
+CommandLog::CommandLog(size_t budget_bytes) : first(0), cursor(0), undoable(0), redoable(0)
+{
+  setBudget(budget_bytes);
+}
+
+void CommandLog::setBudget(size_t budget_bytes)
+{
+  budget_words = budget_bytes / sizeof(uint32_t);
+  while (undoable > 1 && bytes() > budget())
+    dropOldest();
+}
+
+uint32_t* CommandLog::append(Type type, unsigned int index, unsigned int count)
+{
+  if (count > max_count)
+  {
+    clear();
+    return 0;
+  }
+  words.resize(cursor);
+  redoable = 0;
+
+  size_t start = words.size();
+  words.resize(start + count + overhead_words);
+  words[start] = header(type, count);
+  words[start + 1] = index;
+  words[start + header_words + count] = header(type, count);
+  cursor = words.size();
+  undoable++;
+  return &words[start + header_words];
+}
+
+void CommandLog::push(Type type, unsigned int index, const uint32_t* data, unsigned int count)
+{
+  uint32_t* entry = append(type, index, count);
+  if (!entry)
+    return;
+  if (count > 0)
+    std::memcpy(entry, data, count * sizeof(uint32_t));
+  while (undoable > 1 && bytes() > budget())
+    dropOldest();
+}
+
+void CommandLog::push(Type type, unsigned int index, const float* data, unsigned int count)
+{
+  uint32_t* entry = append(type, index, count);
+  if (!entry)
+    return;
+  if (count > 0)
+    std::memcpy(entry, data, count * sizeof(float));
+  while (undoable > 1 && bytes() > budget())
+    dropOldest();
+}
+
+void CommandLog::read(size_t start, Command& command) const
+{
+  command.type = (Type) (words[start] >> 24);
+  command.count = header_count(words[start]);
+  command.index = words[start + 1];
+  command.data = &words[start + header_words];
+}
+
+bool CommandLog::undo(Command& command)
+{
+  if (undoable == 0)
+    return false;
+  size_t start = cursor - overhead_words - header_count(words[cursor - 1]);
+  read(start, command);
+  cursor = start;
+  undoable--;
+  redoable++;
+  return true;
+}
+
+bool CommandLog::redo(Command& command)
+{
+  if (redoable == 0)
+    return false;
+  read(cursor, command);
+  cursor += command.count + overhead_words;
+  undoable++;
+  redoable--;
+  return true;
+}
+
+void CommandLog::clear()
+{
+  words.clear();
+  first = 0;
+  cursor = 0;
+  undoable = 0;
+  redoable = 0;
+}
+
+void CommandLog::dropOldest()
+{
+  first += header_count(words[first]) + overhead_words;
+  undoable--;
+  if (first > words.size() / 2)
+  {
+    words.erase(words.begin(), words.begin() + first);
+    cursor -= first;
+    first = 0;
+  }
+}
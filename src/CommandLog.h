@@ -0,0 +1,90 @@
+#ifndef COMMAND_LOG_H
+#define COMMAND_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Undo history of the edits, each entry only holds what the edit changed:
+// the affine transform applied to a triangle or to runs of triangles (as
+// first, count pairs after the transform) rather than their vertices, the
+// old and new color of a recolored vertex, the old and new layer of a
+// restacked triangle, the old opacities of the vertices an opacity change
+// touched, the data of an inserted or deleted triangle. The entries are
+// packed one after the other into a single array of 32-bit words, the
+// floats being stored bitwise:
+//   header (type << 24 | count), index, count words, header again
+// The trailing header lets undo() step back over an entry in O(count).
+// Past the memory budget the oldest entries are dropped
+class CommandLog
+{
+public:
+  enum Type { INSERT_TRIANGLE, DELETE_TRIANGLE, TRANSFORM_TRIANGLE, RECOLOR_VERTEX, TRANSFORM_TRIANGLES,
+              SET_LAYER, CHANGE_OPACITY, COMPACT_LAYERS };
+
+  // Entry returned by undo() and redo(), data points into the log and stays
+  // valid until the next push()
+  struct Command
+  {
+    Type type;
+    unsigned int index;
+    const uint32_t* data;
+    unsigned int count;
+
+    // The word i of data read as a float
+    float value(unsigned int i) const { return toFloat(data[i]); }
+
+    // Copy count words from first as floats
+    void values(unsigned int first, unsigned int count, float* out) const;
+  };
+
+  explicit CommandLog(size_t budget_bytes = 64 << 20);
+
+  // A float stored bitwise in a word, and read back
+  static uint32_t fromFloat(float value);
+  static float toFloat(uint32_t word);
+
+  // Memory budget, at least the last entry is always kept
+  void setBudget(size_t budget_bytes);
+
+  // Record an edit applied to index, dropping the entries that could be
+  // redone. An entry of more than 2^24 - 1 words cannot be stored, the
+  // whole history is dropped instead
+  void push(Type type, unsigned int index, const uint32_t* data, unsigned int count);
+
+  // Same with count floats stored bitwise
+  void push(Type type, unsigned int index, const float* data, unsigned int count);
+
+  // Step back over the last applied entry, false if there is none
+  bool undo(Command& command);
+
+  // Step forward over the next undone entry, false if there is none
+  bool redo(Command& command);
+
+  // Drop all the entries
+  void clear();
+
+  size_t entries() const { return undoable + redoable; }
+  size_t undoableEntries() const { return undoable; }
+  size_t redoableEntries() const { return redoable; }
+  size_t bytes() const { return (words.size() - first) * sizeof(uint32_t); }
+  size_t budget() const { return budget_words * sizeof(uint32_t); }
+
+private:
+  void read(size_t start, Command& command) const;
+
+  // Make room for an entry of count words at the cursor, false if it is too large
+  uint32_t* append(Type type, unsigned int index, unsigned int count);
+
+  // Drop the oldest entry, the array is compacted once half of it is unused
+  void dropOldest();
+
+  std::vector<uint32_t> words;
+  size_t first;                  // Start of the oldest entry
+  size_t cursor;                 // End of the last applied entry
+  size_t undoable;
+  size_t redoable;
+  size_t budget_words;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "Culling.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+
+void BoundingBox::extend(float x, float y)
+{
+  if (empty())
+  {
+    min_x = max_x = x;
+    min_y = max_y = y;
+    return;
+  }
+  min_x = std::min(min_x, x);
+  min_y = std::min(min_y, y);
+  max_x = std::max(max_x, x);
+  max_y = std::max(max_y, y);
+}
+
+bool BoundingBox::overlaps(const BoundingBox& b) const
+{
+  if (empty() || b.empty())
+    return false;
+  return min_x <= b.max_x && b.min_x <= max_x && min_y <= b.max_y && b.min_y <= max_y;
+}
+
+int clampToInt(float value, int low, int high)
+{
+  if (!(value > low))
+    return low;
+  if (value >= high)
+    return high;
+  return int(value);
+}
+
+bool gridCellRange(const BoundingBox& bounds, int cells_x, int cells_y, const BoundingBox& box, int& x0, int& y0, int& x1, int& y1)
+{
+  if (!box.overlaps(bounds))
+    return false;
+
+  float cell_w = std::max(bounds.max_x - bounds.min_x, 1e-6f) / cells_x;
+  float cell_h = std::max(bounds.max_y - bounds.min_y, 1e-6f) / cells_y;
+
+  x0 = clampToInt((box.min_x - bounds.min_x) / cell_w, 0, cells_x - 1);
+  y0 = clampToInt((box.min_y - bounds.min_y) / cell_h, 0, cells_y - 1);
+  x1 = clampToInt((box.max_x - bounds.min_x) / cell_w, 0, cells_x - 1);
+  y1 = clampToInt((box.max_y - bounds.min_y) / cell_h, 0, cells_y - 1);
+  return true;
+}
+
+bool TriangleGrid::cellRange(const BoundingBox& box, int& x0, int& y0, int& x1, int& y1) const
+{
+  return gridCellRange(bounds, cells_x, cells_y, box, x0, y0, x1, y1);
+}
+
+void TriangleGrid::build(const Eigen::MatrixXf& V)
+{
+  unsigned int triangles = V.cols() / 3;
+
+  triangle_bounds.resize(triangles);
+  bounds = BoundingBox();
+  for (unsigned int t = 0; t < triangles; t++)
+  {
+    BoundingBox b;
+    for (unsigned int i = 0; i < 3; i++)
+      b.extend(V(0, 3*t+i), V(1, 3*t+i));
+    triangle_bounds[t] = b;
+    bounds.extend(b.min_x, b.min_y);
+    bounds.extend(b.max_x, b.max_y);
+  }
+
+  // Aim for a couple of triangles per cell
+  int cells = std::min(1024, std::max(1, int(std::ceil(std::sqrt(triangles / 2.0)))));
+  cells_x = cells;
+  cells_y = cells;
+
+  // Counting sort of the triangles into the cells they cover
+  cell_start.assign(cells_x * cells_y + 1, 0);
+  for (unsigned int t = 0; t < triangles; t++)
+  {
+    int x0, y0, x1, y1;
+    if (!cellRange(triangle_bounds[t], x0, y0, x1, y1))
+      continue;
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++)
+        cell_start[y * cells_x + x + 1]++;
+  }
+  for (unsigned int c = 1; c < cell_start.size(); c++)
+    cell_start[c] += cell_start[c-1];
+
+  cell_items.resize(cell_start.back());
+  std::vector<unsigned int> fill(cell_start.begin(), cell_start.end() - 1);
+  for (unsigned int t = 0; t < triangles; t++)
+  {
+    int x0, y0, x1, y1;
+    if (!cellRange(triangle_bounds[t], x0, y0, x1, y1))
+      continue;
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++)
+        cell_items[fill[y * cells_x + x]++] = t;
+  }
+
+  stamp.assign(triangles, 0);
+  current_stamp = 0;
+}
+
+void TriangleGrid::query(const BoundingBox& box, std::vector<unsigned int>& triangles)
+{
+  int x0, y0, x1, y1;
+  if (!cellRange(box, x0, y0, x1, y1))
+    return;
+
+  // When most of the grid is visible a linear scan is cheaper than
+  // gathering and sorting the cell lists
+  if (2 * (x1 - x0 + 1) * (y1 - y0 + 1) >= cells_x * cells_y)
+  {
+    for (unsigned int t = 0; t < triangle_bounds.size(); t++)
+      if (triangle_bounds[t].overlaps(box))
+        triangles.push_back(t);
+    return;
+  }
+
+  if (++current_stamp == 0)
+  {
+    std::fill(stamp.begin(), stamp.end(), 0);
+    current_stamp = 1;
+  }
+
+  size_t first = triangles.size();
+  for (int y = y0; y <= y1; y++)
+  {
+    for (int x = x0; x <= x1; x++)
+    {
+      int c = y * cells_x + x;
+      for (unsigned int i = cell_start[c]; i < cell_start[c+1]; i++)
+      {
+        unsigned int t = cell_items[i];
+        if (stamp[t] != current_stamp && triangle_bounds[t].overlaps(box))
+        {
+          stamp[t] = current_stamp;
+          triangles.push_back(t);
+        }
+      }
+    }
+  }
+
+  // Triangles are painted in order, keep it
+  std::sort(triangles.begin() + first, triangles.end());
+}
+
+BoundingBox visibleBox(const Eigen::Matrix4f& view, float x0, float y0, float x1, float y1)
+{
+  Eigen::Matrix4f inverse = view.inverse();
+  BoundingBox box;
+  for (int i = 0; i < 4; i++)
+  {
+    Eigen::Vector4f corner(i & 1 ? x1 : x0, i & 2 ? y1 : y0, 0, 1);
+    Eigen::Vector4f world = inverse * corner;
+    box.extend(world.x(), world.y());
+  }
+  return box;
+}
+
+void DirtyRegion::invalidate(const BoundingBox& b)
+{
+  if (b.empty())
+    return;
+  box.extend(b.min_x, b.min_y);
+  box.extend(b.max_x, b.max_y);
+}
+
+void DirtyRegion::clear()
+{
+  everything = false;
+  box = BoundingBox();
+}
+
+void DirtyRegion::screenRect(const Eigen::Matrix4f& view, int width, int height, int margin, int rect[4]) const
+{
+  BoundingBox pixels;
+  for (int i = 0; i < 4; i++)
+  {
+    Eigen::Vector4f corner(i & 1 ? box.max_x : box.min_x, i & 2 ? box.max_y : box.min_y, 0, 1);
+    Eigen::Vector4f canonical = view * corner;
+    pixels.extend((canonical.x() + 1) * width / 2, (canonical.y() + 1) * height / 2);
+  }
+  int x0 = clampToInt(std::floor(pixels.min_x) - margin, 0, width);
+  int y0 = clampToInt(std::floor(pixels.min_y) - margin, 0, height);
+  int x1 = clampToInt(std::ceil(pixels.max_x) + margin, 0, width);
+  int y1 = clampToInt(std::ceil(pixels.max_y) + margin, 0, height);
+  rect[0] = x0;
+  rect[1] = y0;
+  rect[2] = std::max(0, x1 - x0);
+  rect[3] = std::max(0, y1 - y0);
+}
@@ -0,0 +1,113 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+#include <Eigen/Core>
+
+// Axis aligned box in world coordinates
+class BoundingBox
+{
+public:
+  float min_x, min_y, max_x, max_y;
+
+  // A default constructed box is empty
+  BoundingBox() : min_x(1), min_y(1), max_x(-1), max_y(-1) {}
+
+  bool empty() const { return min_x > max_x || min_y > max_y; }
+
+  // Grow the box to contain the point (x,y)
+  void extend(float x, float y);
+
+  // True if the two boxes share at least one point
+  bool overlaps(const BoundingBox& b) const;
+};
+
+// value rounded toward zero after clamping it to [low, high], so that the
+// quotients of far zoomed views never overflow the conversion. NaN gives low
+int clampToInt(float value, int low, int high);
+
+// Cells [x0,x1]x[y0,y1] of a cells_x x cells_y grid over bounds covered by
+// box, false if box misses bounds
+bool gridCellRange(const BoundingBox& bounds, int cells_x, int cells_y, const BoundingBox& box, int& x0, int& y0, int& x1, int& y1);
+
+// Uniform grid that buckets the triangles of a triangle soup (three
+// consecutive columns of V per triangle) by their bounding boxes
+class TriangleGrid
+{
+public:
+  // Revision of the VBO the grid was built from
+  unsigned long revision;
+
+  int cells_x;
+  int cells_y;
+  BoundingBox bounds;
+
+  std::vector<BoundingBox> triangle_bounds;
+
+  // Compressed cell lists: the triangles of cell c are
+  // cell_items[cell_start[c]] ... cell_items[cell_start[c+1]-1]
+  std::vector<unsigned int> cell_start;
+  std::vector<unsigned int> cell_items;
+
+  TriangleGrid() : revision(-1), cells_x(0), cells_y(0), current_stamp(0) {}
+
+  // Rebuild the grid from the vertex positions in V
+  void build(const Eigen::MatrixXf& V);
+
+  // Append the indices of all the triangles overlapping box, in draw order
+  void query(const BoundingBox& box, std::vector<unsigned int>& triangles);
+
+  // Range of cells covered by box, false if it misses the grid
+  bool cellRange(const BoundingBox& box, int& x0, int& y0, int& x1, int& y1) const;
+
+protected:
+  // Per triangle marker used to report triangles spanning several cells once
+  std::vector<unsigned int> stamp;
+  unsigned int current_stamp;
+};
+
+// Cost and effectiveness of the last culling pass
+class CullStats
+{
+public:
+  double cull_ms;
+  unsigned int total;
+  unsigned int visible;
+
+  CullStats() : cull_ms(0), total(0), visible(0) {}
+
+  float culledPercent() const { return total ? 100.0f * (total - visible) / total : 0.0f; }
+};
+
+// World space box covered by the canonical view volume [-1,1]^2 under view,
+// or by the part [x0,x1]x[y0,y1] of it
+BoundingBox visibleBox(const Eigen::Matrix4f& view, float x0 = -1, float y0 = -1, float x1 = 1, float y1 = 1);
+
+// What changed on screen since the last frame: nothing, some areas of the
+// scene in world coordinates, or everything
+class DirtyRegion
+{
+public:
+  bool everything;
+  BoundingBox box;
+
+  // Everything is dirty until the first frame is drawn
+  DirtyRegion() : everything(true) {}
+
+  bool empty() const { return !everything && box.empty(); }
+
+  // Mark the whole screen as changed
+  void invalidate() { everything = true; }
+
+  // Mark the area covered by b as changed
+  void invalidate(const BoundingBox& b);
+
+  // Forget the changes once they are drawn
+  void clear();
+
+  // Pixels x, y, width, height of a width x height viewport covering box
+  // under view, grown by margin pixels and clamped to the viewport
+  void screenRect(const Eigen::Matrix4f& view, int width, int height, int margin, int rect[4]) const;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "EditThread.h"
+
+#include <chrono>
+
+EditThread::EditThread() : running(false), started(false), stopping(false), worker(&EditThread::run, this)
+{
+}
+
+EditThread::~EditThread()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  worker.join();
+}
+
+bool EditThread::start(const std::function<void()>& edit)
+{
+  if (started)
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->edit = edit;
+    running = true;
+  }
+  started = true;
+  wake.notify_one();
+  return true;
+}
+
+bool EditThread::finished()
+{
+  if (!started)
+    return false;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (running)
+    return false;
+  edit = nullptr;
+  started = false;
+  return true;
+}
+
+void EditThread::wait(double timeout)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  if (timeout < 0)
+    done.wait(lock, [this] { return !running; });
+  else
+    done.wait_for(lock, std::chrono::duration<double>(timeout), [this] { return !running; });
+}
+
+void EditThread::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    wake.wait(lock, [this] { return stopping || running; });
+    if (stopping)
+      return;
+
+    // The edit runs unlocked, start() leaves it alone until finished() saw it done
+    lock.unlock();
+    edit();
+    lock.lock();
+    running = false;
+    done.notify_one();
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef EDIT_THREAD_H
+#define EDIT_THREAD_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Worker running the long edits of the scene one at a time, so that the
+// thread that started them goes on drawing. start() hands over an edit and
+// finished() tells the starting thread once it is done. The edit owns what
+// it writes until then, the starting thread must leave it alone meanwhile
+class EditThread
+{
+public:
+  EditThread();
+  ~EditThread();
+
+  // Run edit on the worker, false if the previous edit was not finished yet
+  bool start(const std::function<void()>& edit);
+
+  // Whether an edit was started and not yet seen finished
+  bool busy() const { return started; }
+
+  // True once per edit, when the edit started last is done
+  bool finished();
+
+  // Block until the edit is done, at most timeout seconds or forever if
+  // timeout is negative
+  void wait(double timeout);
+
+private:
+  void run();
+
+  std::mutex mutex;
+  std::condition_variable wake;  // Wakes the worker on start or destruction
+  std::condition_variable done;  // Wakes wait()
+  std::function<void()> edit;    // Edit started last
+  bool running;                  // Until the worker returns from edit
+  bool started;                  // Until finished() sees it done, only used by the starting thread
+  bool stopping;
+  std::thread worker;
+};
+
+#endif
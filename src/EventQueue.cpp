@@ -0,0 +1,56 @@
+#include "EventQueue.h"
+
+EventQueue::EventQueue(unsigned int capacity) : ring(capacity + 1), read(0), write(0), full(false)
+{
+}
+
+bool EventQueue::push(const InputEvent& event)
+{
+  unsigned int w = write.load(std::memory_order_relaxed);
+  unsigned int next = (w + 1) % ring.size();
+  if (next == read.load(std::memory_order_acquire))
+  {
+    // The fences pair with overflowed(): the consumer sees the flag or we see its pop
+    full.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (next == read.load(std::memory_order_acquire))
+      return false;
+  }
+  ring[w] = event;
+  write.store(next, std::memory_order_release);
+
+  // Taking the mutex orders the notification after the check in wait()
+  std::lock_guard<std::mutex> lock(sleep_mutex);
+  wake.notify_one();
+  return true;
+}
+
+bool EventQueue::pop(InputEvent& event)
+{
+  unsigned int r = read.load(std::memory_order_relaxed);
+  if (r == write.load(std::memory_order_acquire))
+    return false;
+  event = ring[r];
+  read.store((r + 1) % ring.size(), std::memory_order_release);
+  return true;
+}
+
+bool EventQueue::empty() const
+{
+  return read.load(std::memory_order_acquire) == write.load(std::memory_order_acquire);
+}
+
+bool EventQueue::overflowed()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return full.exchange(false, std::memory_order_relaxed);
+}
+
+void EventQueue::wait(double timeout)
+{
+  std::unique_lock<std::mutex> lock(sleep_mutex);
+  if (timeout < 0)
+    wake.wait(lock, [this] { return !empty(); });
+  else
+    wake.wait_for(lock, std::chrono::duration<double>(timeout), [this] { return !empty(); });
+}
@@ -0,0 +1,63 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Window event recorded by the GLFW callbacks, with the state that can only
+// be queried on the thread processing the window events
+struct InputEvent
+{
+  enum Type { KEY, MOUSE_BUTTON, CURSOR_POSITION, FRAMEBUFFER_SIZE, REFRESH, QUIT };
+
+  Type type;
+  int key, scancode, action, mods;  // Keys and mouse buttons (in key)
+  double x, y;                      // Cursor position in screen coordinates
+  int width, height;                // Window size in screen coordinates
+  int framebuffer_width, framebuffer_height;
+  std::chrono::steady_clock::time_point time;
+
+  explicit InputEvent(Type type = REFRESH) : type(type), key(0), scancode(0), action(0), mods(0), x(0), y(0), width(0), height(0), framebuffer_width(0), framebuffer_height(0) {}
+};
+
+// Bounded queue of events from one producer thread to one consumer thread.
+// push() and pop() never lock: the two threads only share the read and write
+// positions of a ring buffer. The mutex is only taken to put the consumer to
+// sleep in wait() and to wake it up after a push. The producer is never
+// blocked: a failed push is remembered until the consumer takes it with
+// overflowed() after making room
+class EventQueue
+{
+public:
+  explicit EventQueue(unsigned int capacity = 4096);
+
+  // Append an event, false if the queue is full
+  bool push(const InputEvent& event);
+
+  // Take the oldest event, false if the queue is empty
+  bool pop(InputEvent& event);
+
+  bool empty() const;
+
+  // Whether a push failed since the last call, to be called by the consumer
+  // after popping. A push failing concurrently is either seen here or finds
+  // the room made by the pops
+  bool overflowed();
+
+  // Block until an event is queued, at most timeout seconds or forever if
+  // timeout is negative
+  void wait(double timeout);
+
+private:
+  std::vector<InputEvent> ring;
+  std::atomic<unsigned int> read;   // Next slot to pop, written by the consumer
+  std::atomic<unsigned int> write;  // Next slot to push, written by the producer
+  std::atomic<bool> full;           // Set by a failed push, cleared by overflowed()
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+};
+
+#endif
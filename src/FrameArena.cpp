@@ -0,0 +1,73 @@
+#include "FrameArena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace
+{
+  char* align(char* p, size_t alignment)
+  {
+    uintptr_t address = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char*>((address + alignment - 1) & ~(uintptr_t) (alignment - 1));
+  }
+}
+
+FrameArena::FrameArena(size_t initial_bytes) : block(0), block_size(initial_bytes), offset(0), overflow_bytes(0), peak(0)
+{
+  block = static_cast<char*>(std::malloc(block_size));
+}
+
+FrameArena::~FrameArena()
+{
+  for (size_t i = 0; i < overflow.size(); i++)
+    std::free(overflow[i]);
+  std::free(block);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+  char* p = align(block + offset, alignment);
+  if (p + bytes <= block + block_size)
+  {
+    offset = p - block + bytes;
+    return p;
+  }
+
+  // Past the block the allocations are served by the heap until the next reset
+  char* extra = static_cast<char*>(std::malloc(bytes + alignment));
+  overflow.push_back(extra);
+  overflow_bytes += bytes + alignment;
+  return align(extra, alignment);
+}
+
+size_t FrameArena::used() const
+{
+  return offset + overflow_bytes;
+}
+
+void FrameArena::reset()
+{
+  size_t frame = used();
+  if (frame > peak)
+    peak = frame;
+  if (!overflow.empty())
+  {
+    for (size_t i = 0; i < overflow.size(); i++)
+      std::free(overflow[i]);
+    overflow.clear();
+
+    // Grow the block to the peak of this frame with some room
+    std::free(block);
+    block_size = frame + frame / 2;
+    block = static_cast<char*>(std::malloc(block_size));
+  }
+  offset = 0;
+  overflow_bytes = 0;
+}
+
+size_t FrameArena::takePeak()
+{
+  size_t p = peak > used() ? peak : used();
+  peak = 0;
+  return p;
+}
@@ -0,0 +1,68 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Linear allocator for the temporaries of one frame: allocate() bumps an
+// offset into a block and reset() releases everything at once. When a frame
+// needs more than the block, overflow blocks are taken from the heap and the
+// next reset() replaces them with one block large enough for that peak, so
+// that frames of a steady size never reach the heap
+class FrameArena
+{
+public:
+  explicit FrameArena(size_t initial_bytes = 1 << 20);
+  ~FrameArena();
+
+  // Uninitialized memory valid until the next reset()
+  void* allocate(size_t bytes, size_t alignment = 16);
+
+  template <typename T>
+  T* allocate(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+  // Release all the allocations of the frame
+  void reset();
+
+  size_t capacity() const { return block_size; }
+  size_t used() const;
+
+  // Largest use between two resets since the last call
+  size_t takePeak();
+
+private:
+  FrameArena(const FrameArena&);
+  FrameArena& operator=(const FrameArena&);
+
+  char* block;
+  size_t block_size;
+  size_t offset;
+  std::vector<char*> overflow;
+  size_t overflow_bytes;
+  size_t peak;
+};
+
+// Standard allocator drawing from a FrameArena, for containers that do not
+// outlive the frame. Deallocation is a no-op, the memory returns on reset()
+template <typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+
+  FrameArena* arena;
+
+  explicit ArenaAllocator(FrameArena& arena) : arena(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+  T* allocate(size_t n) { return arena->allocate<T>(n); }
+  void deallocate(T*, size_t) {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "Geometry.h"
+
+#include <cmath>
+
+#define PI 3.14159265
+
+bool ptInTriangle(float px, float py, float v0x, float v0y, float v1x, float v1y, float v2x, float v2y)
+{
+  float dX = px-v2x;
+  float dY = py-v2y;
+  float dX21 = v2x-v1x;
+  float dY12 = v1y-v2y;
+  float D = dY12*(v0x-v2x) + dX21*(v0y-v2y);
+  float s = dY12*dX + dX21*dY;
+  float t = (v2y-v0y)*dX + (v0x-v2x)*dY;
+  if (D<0) return s<=0 && t<=0 && s+t>=D;
+  return s>=0 && t>=0 && s+t<=D;
+}
+
+void centroid_of_triangle(float v0x, float v0y, float v1x, float v1y, float v2x, float v2y, float &px, float &py)
+{
+  px = (v0x + v1x + v2x) / 3;
+  py = (v0y + v1y + v2y) / 3;
+}
+
+void removeColumn(Eigen::MatrixXf& matrix, unsigned int colToRemove)
+{
+  unsigned int numRows = matrix.rows();
+  unsigned int numCols = matrix.cols()-1;
+
+  if (colToRemove < numCols)
+    matrix.block(0,colToRemove,numRows,numCols-colToRemove) = matrix.rightCols(numCols-colToRemove);
+
+  matrix.conservativeResize(numRows,numCols);
+}
+
+void removeTriangles(Eigen::MatrixXf& matrix, const std::vector<unsigned int>& triangles)
+{
+  unsigned int kept = 0, next = 0;
+  unsigned int count = matrix.cols() / 3;
+  for (unsigned int t = 0; t < count; t++)
+  {
+    if (next < triangles.size() && triangles[next] == t)
+    {
+      next++;
+      continue;
+    }
+    if (kept != t)
+      matrix.middleCols(3*kept, 3) = matrix.middleCols(3*t, 3);
+    kept++;
+  }
+  unsigned int tail = matrix.cols() - 3*count;
+  if (tail > 0 && kept != count)
+    matrix.middleCols(3*kept, tail) = matrix.rightCols(tail);
+  matrix.conservativeResize(Eigen::NoChange, 3*kept + tail);
+}
+
+Eigen::Matrix4f rotate(double degree)
+{
+  Eigen::Matrix4f rotation;
+  rotation <<
+  cos(degree*PI/180), -sin(degree*PI/180), 0, 0,
+  sin(degree*PI/180), cos(degree*PI/180), 0, 0,
+  0, 0, 1, 0,
+  0, 0, 0, 1;
+  return rotation;
+}
+
+Eigen::Matrix4f translate(float x, float y)
+{
+  Eigen::Matrix4f translation;
+  translation <<
+  1, 0, 0, x,
+  0, 1, 0, y,
+  0, 0, 1, 0,
+  0, 0, 0, 1;
+  return translation;
+}
+
+Eigen::Matrix4f scale(float zoom)
+{
+  Eigen::Matrix4f scaling;
+  scaling <<
+  zoom, 0, 0, 0,
+  0, zoom, 0, 0,
+  0, 0, 1, 0,
+  0, 0, 0, 1;
+  return scaling;
+}
+
+int pickTriangle(const Eigen::MatrixXf& V, float x, float y)
+{
+  // From the last triangle, the first hit is the one on top
+  for (int t = V.cols()/3 - 1; t >= 0; t--)
+  {
+    const float* p = V.data() + 6*t;
+    if (ptInTriangle(x, y, p[0], p[1], p[2], p[3], p[4], p[5]))
+      return 3*t;
+  }
+  return -1;
+}
+
+int nearestVertex(const Eigen::MatrixXf& V, float x, float y)
+{
+  // The squared distance has the same minimum without the square roots
+  int nearest = -1;
+  float nearDistance = 0;
+  for (int i = 0; i < V.cols(); i++)
+  {
+    float dx = V(0, i) - x, dy = V(1, i) - y;
+    float distance = dx*dx + dy*dy;
+    if (nearest < 0 || distance < nearDistance)
+    {
+      nearest = i;
+      nearDistance = distance;
+    }
+  }
+  return nearest;
+}
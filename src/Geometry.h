@@ -0,0 +1,31 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <Eigen/Core>
+#include <vector>
+
+// Whether the point p is inside the triangle v0 v1 v2, edges included
+bool ptInTriangle(float px, float py, float v0x, float v0y, float v1x, float v1y, float v2x, float v2y);
+
+void centroid_of_triangle(float v0x, float v0y, float v1x, float v1y, float v2x, float v2y, float &px, float &py);
+
+// Remove a column of the matrix, shifting the next ones to the left
+void removeColumn(Eigen::MatrixXf& matrix, unsigned int colToRemove);
+
+// Remove the triangles of the sorted list (3 columns each) in one pass, shifting the next
+// columns to the left. The columns after the last whole triangle are kept
+void removeTriangles(Eigen::MatrixXf& matrix, const std::vector<unsigned int>& triangles);
+
+// Affine transforms of the xy plane
+Eigen::Matrix4f rotate(double degree);
+Eigen::Matrix4f translate(float x, float y);
+Eigen::Matrix4f scale(float zoom);
+
+// Last triangle of the soup V (3 columns per triangle) containing the point,
+// the one drawn on top, as its first column. -1 if there is none
+int pickTriangle(const Eigen::MatrixXf& V, float x, float y);
+
+// Column of V closest to the point, -1 if V is empty
+int nearestVertex(const Eigen::MatrixXf& V, float x, float y);
+
+#endif
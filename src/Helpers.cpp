@@ -1,5 +1,11 @@
 #include "Helpers.h"
+#include "ShaderCache.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <iostream>
 #include <fstream>
 
@@ -39,49 +45,462 @@ void VertexBufferObject::free()
   check_gl_error();
 }
 
+namespace
+{
+  // IEEE 754 binary16 with round to nearest even
+  unsigned short float_to_half(float f)
+  {
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+    unsigned int sign = (x >> 16) & 0x8000;
+    int exponent = int((x >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff)
+      return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31)
+      return sign | 0x7c00;
+    if (exponent <= 0)
+    {
+      if (exponent < -10)
+        return sign;
+      mantissa |= 0x800000;
+      unsigned int shift = 14 - exponent;
+      unsigned int half = mantissa >> shift;
+      unsigned int rest = mantissa & ((1u << shift) - 1);
+      unsigned int halfway = 1u << (shift - 1);
+      if (rest > halfway || (rest == halfway && (half & 1)))
+        half++;
+      return sign | half;
+    }
+
+    unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+    unsigned int rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+      half++;
+    return half;
+  }
+
+  float half_to_float(unsigned short h)
+  {
+    float sign = (h & 0x8000) ? -1.0f : 1.0f;
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    if (exponent == 0)
+      return sign * std::ldexp(float(mantissa), -24);
+    if (exponent == 31)
+      return mantissa ? std::numeric_limits<float>::quiet_NaN() : sign * std::numeric_limits<float>::infinity();
+    return sign * std::ldexp(float(mantissa | 0x400), exponent - 25);
+  }
+
+  // Keep the 8 bit attributes 4 bytes aligned
+  unsigned int components_of(VertexFormat format, unsigned int rows)
+  {
+    return format == FORMAT_UNORM8 ? 4 : rows;
+  }
+
+  unsigned int format_size(VertexFormat format)
+  {
+    switch (format)
+    {
+      case FORMAT_HALF_FLOAT:
+      case FORMAT_UNORM16:    return 2;
+      case FORMAT_UNORM8:     return 1;
+      default:                return 4;
+    }
+  }
+}
+
 void VertexBufferObject::update(const Eigen::MatrixXf& M)
+{
+  update(M.data(), M.rows(), M.cols());
+}
+
+void VertexBufferObject::update(const float *data, GLuint rows, GLuint cols)
 {
   assert(id != 0);
+  this->rows = rows;
+  this->cols = cols;
+  packingRange(format, data, rows, cols, origin, extent);
+
+  glBindBuffer(GL_ARRAY_BUFFER, id);
+  if (format == FORMAT_FLOAT32)
+  {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*rows*cols, data, GL_DYNAMIC_DRAW);
+  }
+  else
+  {
+    packColumns(format, data, rows, cols, origin, extent, packed);
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.empty() ? NULL : &packed[0], GL_DYNAMIC_DRAW);
+  }
+  revision++;
+  check_gl_error();
+}
+
+bool VertexBufferObject::updateColumns(const float *data, GLuint first, GLuint count)
+{
+  assert(id != 0 && first + count <= cols);
+  if (count == 0)
+    return true;
+  if (!fitsPackingRange(format, data, rows, count, origin, extent))
+    return false;
+
   glBindBuffer(GL_ARRAY_BUFFER, id);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(float)*M.size(), M.data(), GL_DYNAMIC_DRAW);
-  rows = M.rows();
-  cols = M.cols();
+  if (format == FORMAT_FLOAT32)
+  {
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(float)*rows*first, sizeof(float)*rows*count, data);
+  }
+  else
+  {
+    packColumns(format, data, rows, count, origin, extent, packed);
+    glBufferSubData(GL_ARRAY_BUFFER, packed.size()/count*first, packed.size(), &packed[0]);
+  }
+  revision++;
+  check_gl_error();
+  return true;
+}
+
+void packingRange(VertexFormat format, const float *data, unsigned int rows, unsigned int cols, float origin[4], float extent[4])
+{
+  // The range of each row is only needed by the relative formats
+  for (unsigned int r = 0; r < 4; r++)
+  {
+    origin[r] = 0;
+    extent[r] = 1;
+  }
+  if ((format != FORMAT_HALF_FLOAT && format != FORMAT_UNORM16) || cols == 0)
+    return;
+  for (unsigned int r = 0; r < rows && r < 4; r++)
+  {
+    float lo = data[r], hi = data[r];
+    for (unsigned int c = 1; c < cols; c++)
+    {
+      lo = std::min(lo, data[c*rows+r]);
+      hi = std::max(hi, data[c*rows+r]);
+    }
+    if (format == FORMAT_HALF_FLOAT)
+    {
+      origin[r] = (lo + hi) / 2;
+    }
+    else
+    {
+      origin[r] = lo;
+      extent[r] = hi > lo ? hi - lo : 1;
+    }
+  }
+}
+
+bool fitsPackingRange(VertexFormat format, const float *data, unsigned int rows, unsigned int count, const float origin[4], const float extent[4])
+{
+  if (format != FORMAT_UNORM16)
+    return true;
+  for (unsigned int i = 0; i < rows*count; i++)
+  {
+    unsigned int r = i % rows;
+    // As packColumns computes it, origin + extent may round below the largest value
+    if (r < 4 && (data[i] < origin[r] || data[i] - origin[r] > extent[r]))
+      return false;
+  }
+  return true;
+}
+
+void packColumns(VertexFormat format, const float *data, unsigned int rows, unsigned int count,
+                 const float origin[4], const float extent[4], std::vector<unsigned char> &packed)
+{
+  unsigned int n = components_of(format, rows);
+  assert(n <= 4);
+  packed.resize(format_size(format)*n*count);
+  for (unsigned int c = 0; c < count; c++)
+  {
+    for (unsigned int r = 0; r < n; r++)
+    {
+      unsigned int i = c*n + r;
+      float value = r < rows ? data[c*rows + r] : 1.0f;
+      switch (format)
+      {
+        case FORMAT_HALF_FLOAT:
+        {
+          unsigned short h = float_to_half(value - origin[r]);
+          memcpy(&packed[2*i], &h, 2);
+          break;
+        }
+        case FORMAT_UNORM16:
+        {
+          float q = std::min(1.0f, std::max(0.0f, (value - origin[r]) / extent[r]));
+          unsigned short u = (unsigned short) (q * 65535.0f + 0.5f);
+          memcpy(&packed[2*i], &u, 2);
+          break;
+        }
+        case FORMAT_UNORM8:
+          packed[i] = (unsigned char) (std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+          break;
+        default:
+          memcpy(&packed[4*i], &value, 4);
+          break;
+      }
+    }
+  }
+}
+
+void unpackColumns(VertexFormat format, const std::vector<unsigned char> &packed, unsigned int rows, unsigned int count,
+                   const float origin[4], const float extent[4], float *data)
+{
+  unsigned int n = components_of(format, rows);
+  for (unsigned int c = 0; c < count; c++)
+  {
+    for (unsigned int r = 0; r < rows && r < n; r++)
+    {
+      unsigned int i = c*n + r;
+      float &value = data[c*rows + r];
+      switch (format)
+      {
+        case FORMAT_HALF_FLOAT:
+        {
+          unsigned short h;
+          memcpy(&h, &packed[2*i], 2);
+          value = half_to_float(h) + origin[r];
+          break;
+        }
+        case FORMAT_UNORM16:
+        {
+          unsigned short u;
+          memcpy(&u, &packed[2*i], 2);
+          value = u / 65535.0f * extent[r] + origin[r];
+          break;
+        }
+        case FORMAT_UNORM8:
+          value = packed[i] / 255.0f;
+          break;
+        default:
+          memcpy(&value, &packed[4*i], 4);
+          break;
+      }
+    }
+  }
+}
+
+VertexBufferObject::GLuint VertexBufferObject::components() const
+{
+  return components_of(format, rows);
+}
+
+VertexBufferObject::GLuint VertexBufferObject::bytesPerColumn() const
+{
+  return components() * format_size(format);
+}
+
+GLenum VertexBufferObject::type() const
+{
+  switch (format)
+  {
+    case FORMAT_HALF_FLOAT: return GL_HALF_FLOAT;
+    case FORMAT_UNORM16:    return GL_UNSIGNED_SHORT;
+    case FORMAT_UNORM8:     return GL_UNSIGNED_BYTE;
+    default:                return GL_FLOAT;
+  }
+}
+
+bool VertexBufferObject::normalized() const
+{
+  return format == FORMAT_UNORM16 || format == FORMAT_UNORM8;
+}
+
+Eigen::Matrix4f VertexBufferObject::decode() const
+{
+  Eigen::Matrix4f M = Eigen::Matrix4f::Identity();
+  M(0,0) = extent[0];
+  M(1,1) = extent[1];
+  M(0,3) = origin[0];
+  M(1,3) = origin[1];
+  return M;
+}
+
+void ElementBufferObject::init()
+{
+  glGenBuffers(1,&id);
+  check_gl_error();
+}
+
+void ElementBufferObject::bind()
+{
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,id);
+  check_gl_error();
+}
+
+void ElementBufferObject::free()
+{
+  glDeleteBuffers(1,&id);
+  check_gl_error();
+}
+
+void ElementBufferObject::update(const std::vector<unsigned int>& I)
+{
+  assert(id != 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*I.size(), I.empty() ? NULL : &I[0], GL_DYNAMIC_DRAW);
+  size = I.size();
   check_gl_error();
 }
 
 bool Program::init(
   const std::string &vertex_shader_string,
   const std::string &fragment_shader_string,
-  const std::string &fragment_data_name)
+  const std::string &fragment_data_name,
+  const std::string &geometry_shader_string,
+  const std::vector<std::string> &attribute_locations,
+  ProgramCache *cache)
 {
   using namespace std;
-  vertex_shader = create_shader_helper(GL_VERTEX_SHADER, vertex_shader_string);
-  fragment_shader = create_shader_helper(GL_FRAGMENT_SHADER, fragment_shader_string);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  bool linked = begin(vertex_shader_string, fragment_shader_string, fragment_data_name, geometry_shader_string, attribute_locations, cache) && finish();
+  if (cache)
+    cache->addInitTime(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+  return linked;
+}
 
+namespace
+{
+  // Compile without asking for the status, which would wait for the driver
+  GLuint submit_shader(GLenum type, const std::string &shader_string)
+  {
+    if (shader_string.empty())
+      return 0;
+    GLuint id = glCreateShader(type);
+    const char *shader_string_const = shader_string.c_str();
+    glShaderSource(id, 1, &shader_string_const, NULL);
+    glCompileShader(id);
+    return id;
+  }
+
+  // Print the source and the complete log of a shader that failed to compile
+  bool check_shader(GLenum type, GLuint id)
+  {
+    using namespace std;
+    GLint status;
+    glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+    if (status == GL_TRUE)
+      return true;
+
+    GLint length = 0;
+    glGetShaderiv(id, GL_SHADER_SOURCE_LENGTH, &length);
+    vector<char> source(length + 1, 0);
+    glGetShaderSource(id, length + 1, NULL, &source[0]);
+    glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+    vector<char> buffer(length + 1, 0);
+    glGetShaderInfoLog(id, length + 1, NULL, &buffer[0]);
+    if (type == GL_VERTEX_SHADER)
+      cerr << "Vertex shader:" << endl;
+    else if (type == GL_FRAGMENT_SHADER)
+      cerr << "Fragment shader:" << endl;
+    else if (type == GL_GEOMETRY_SHADER)
+      cerr << "Geometry shader:" << endl;
+    cerr << &source[0] << endl << endl;
+    cerr << "Error: " << endl << &buffer[0] << endl;
+    return false;
+  }
+}
+
+bool Program::begin(
+  const std::string &vertex_shader_string,
+  const std::string &fragment_shader_string,
+  const std::string &fragment_data_name,
+  const std::string &geometry_shader_string,
+  const std::vector<std::string> &attribute_locations,
+  ProgramCache *cache)
+{
+  using namespace std;
+  linking = false;
+  cache_key.clear();
+  link_cache = 0;
+  if (cache && cache->enabled())
+  {
+    vector<string> parts;
+    parts.push_back(vertex_shader_string);
+    parts.push_back(fragment_shader_string);
+    parts.push_back(geometry_shader_string);
+    parts.push_back(fragment_data_name);
+    parts.insert(parts.end(), attribute_locations.begin(), attribute_locations.end());
+    cache_key = cache->key(parts);
+    link_cache = cache;
+
+    program_shader = glCreateProgram();
+    if (cache->load(program_shader, cache_key))
+    {
+      cache->hits++;
+      return true;
+    }
+    glDeleteProgram(program_shader);
+    program_shader = 0;
+    cache->misses++;
+  }
+
+  vertex_shader = submit_shader(GL_VERTEX_SHADER, vertex_shader_string);
+  fragment_shader = submit_shader(GL_FRAGMENT_SHADER, fragment_shader_string);
+  geometry_shader = submit_shader(GL_GEOMETRY_SHADER, geometry_shader_string);
   if (!vertex_shader || !fragment_shader)
+  {
+    free();
     return false;
+  }
 
   program_shader = glCreateProgram();
 
   glAttachShader(program_shader, vertex_shader);
   glAttachShader(program_shader, fragment_shader);
+  if (geometry_shader)
+    glAttachShader(program_shader, geometry_shader);
+
+  for (unsigned int i = 0; i < attribute_locations.size(); i++)
+    glBindAttribLocation(program_shader, i, attribute_locations[i].c_str());
 
   glBindFragDataLocation(program_shader, 0, fragment_data_name.c_str());
+  if (link_cache)
+    glProgramParameteri(program_shader, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(program_shader);
+  linking = true;
+  return true;
+}
+
+bool Program::completed() const
+{
+  if (!linking)
+    return true;
+  GLint done = GL_TRUE;
+  glGetProgramiv(program_shader, GL_COMPLETION_STATUS, &done);
+  return done == GL_TRUE;
+}
+
+bool Program::finish()
+{
+  using namespace std;
+  if (!linking)
+    return program_shader != 0;
+  linking = false;
 
   GLint status;
   glGetProgramiv(program_shader, GL_LINK_STATUS, &status);
 
   if (status != GL_TRUE)
   {
-    char buffer[512];
-    glGetProgramInfoLog(program_shader, 512, NULL, buffer);
-    cerr << "Linker error: " << endl << buffer << endl;
-    program_shader = 0;
+    // Every shader reports its errors, the link log only matters when they all compiled
+    bool vertex_compiled = check_shader(GL_VERTEX_SHADER, vertex_shader);
+    bool fragment_compiled = check_shader(GL_FRAGMENT_SHADER, fragment_shader);
+    bool geometry_compiled = !geometry_shader || check_shader(GL_GEOMETRY_SHADER, geometry_shader);
+    if (vertex_compiled && fragment_compiled && geometry_compiled)
+    {
+      GLint length = 0;
+      glGetProgramiv(program_shader, GL_INFO_LOG_LENGTH, &length);
+      vector<char> buffer(length + 1, 0);
+      glGetProgramInfoLog(program_shader, length + 1, NULL, &buffer[0]);
+      cerr << "Linker error: " << endl << &buffer[0] << endl;
+    }
+    free();
     return false;
   }
 
   check_gl_error();
+  if (link_cache)
+    link_cache->store(program_shader, cache_key);
   return true;
 }
 
@@ -93,16 +512,33 @@ void Program::bind()
 
 GLint Program::attrib(const std::string &name) const
 {
-  return glGetAttribLocation(program_shader, name.c_str());
+  return attrib(name.c_str());
+}
+
+GLint Program::attrib(const char *name) const
+{
+  return glGetAttribLocation(program_shader, name);
 }
 
 GLint Program::uniform(const std::string &name) const
 {
-  return glGetUniformLocation(program_shader, name.c_str());
+  return uniform(name.c_str());
+}
+
+GLint Program::uniform(const char *name) const
+{
+  return glGetUniformLocation(program_shader, name);
 }
 
 GLint Program::bindVertexAttribArray(
         const std::string &name, VertexBufferObject& VBO) const
+{
+  return bindVertexAttribArray(name, VBO, VBO.components(), 0, 0);
+}
+
+GLint Program::bindVertexAttribArray(
+        const std::string &name, VertexBufferObject& VBO,
+        GLuint components, GLuint stride, GLuint offset) const
 {
   GLint id = attrib(name);
   if (id < 0)
@@ -114,7 +550,7 @@ GLint Program::bindVertexAttribArray(
   }
   VBO.bind();
   glEnableVertexAttribArray(id);
-  glVertexAttribPointer(id, VBO.rows, GL_FLOAT, GL_FALSE, 0, 0);
+  glVertexAttribPointer(id, components, VBO.type(), VBO.normalized() ? GL_TRUE : GL_FALSE, stride, (const GLvoid *) (size_t) offset);
   check_gl_error();
 
   return id;
@@ -122,6 +558,7 @@ GLint Program::bindVertexAttribArray(
 
 void Program::free()
 {
+  linking = false;
   if (program_shader)
   {
     glDeleteProgram(program_shader);
@@ -137,35 +574,22 @@ void Program::free()
     glDeleteShader(fragment_shader);
     fragment_shader = 0;
   }
+  if (geometry_shader)
+  {
+    glDeleteShader(geometry_shader);
+    geometry_shader = 0;
+  }
   check_gl_error();
 }
 
 GLuint Program::create_shader_helper(GLint type, const std::string &shader_string)
 {
-  using namespace std;
-  if (shader_string.empty())
+  GLuint id = submit_shader(type, shader_string);
+  if (!id)
     return (GLuint) 0;
-
-  GLuint id = glCreateShader(type);
-  const char *shader_string_const = shader_string.c_str();
-  glShaderSource(id, 1, &shader_string_const, NULL);
-  glCompileShader(id);
-
-  GLint status;
-  glGetShaderiv(id, GL_COMPILE_STATUS, &status);
-
-  if (status != GL_TRUE)
+  if (!check_shader(type, id))
   {
-    char buffer[512];
-    if (type == GL_VERTEX_SHADER)
-      cerr << "Vertex shader:" << endl;
-    else if (type == GL_FRAGMENT_SHADER)
-      cerr << "Fragment shader:" << endl;
-    else if (type == GL_GEOMETRY_SHADER)
-      cerr << "Geometry shader:" << endl;
-    cerr << shader_string << endl << endl;
-    glGetShaderInfoLog(id, 512, NULL, buffer);
-    cerr << "Error: " << endl << buffer << endl;
+    glDeleteShader(id);
     return (GLuint) 0;
   }
   check_gl_error();
@@ -27,6 +27,13 @@
 #   include <GL/gl.h>
 #endif
 
+class ProgramCache;
+
+// Link status query of KHR_parallel_shader_compile, missing from the bundled GLEW
+#ifndef GL_COMPLETION_STATUS
+#  define GL_COMPLETION_STATUS 0x91B1
+#endif
+
 class VertexArrayObject
 {
 public:
@@ -44,6 +51,40 @@ public:
     void free();
 };
 
+// Storage formats of the components of a VertexBufferObject. The data is
+// always given as floats and converted on upload:
+// - FORMAT_HALF_FLOAT stores each row relative to the center of its range,
+//   the error is at most 2^-11 of the distance to that center, or 2^-25
+//   close to it. Values 65504 or more away from the center overflow
+// - FORMAT_UNORM16 maps each row to [0,1] over its range, the error is at
+//   most extent/131070 plus the float rounding of decode()
+// - FORMAT_UNORM8 clamps to [0,1] and pads to 4 components (RGBA8 colors),
+//   the error is at most 1/510
+// Positions stored relative to an origin must be drawn with decode()
+enum VertexFormat
+{
+    FORMAT_FLOAT32,
+    FORMAT_HALF_FLOAT,
+    FORMAT_UNORM16,
+    FORMAT_UNORM8
+};
+
+// Per row origin and extent of cols columns of rows floats stored in format,
+// identity for the formats that are not relative to a range
+void packingRange(VertexFormat format, const float *data, unsigned int rows, unsigned int cols, float origin[4], float extent[4]);
+
+// Whether count columns can be stored in the range of an earlier packingRange
+bool fitsPackingRange(VertexFormat format, const float *data, unsigned int rows, unsigned int count, const float origin[4], const float extent[4]);
+
+// Convert count columns of rows floats to format, as uploaded by VertexBufferObject
+void packColumns(VertexFormat format, const float *data, unsigned int rows, unsigned int count,
+                 const float origin[4], const float extent[4], std::vector<unsigned char> &packed);
+
+// The floats the vertex shader reads back from packed columns, with decode()
+// applied to the relative formats
+void unpackColumns(VertexFormat format, const std::vector<unsigned char> &packed, unsigned int rows, unsigned int count,
+                   const float origin[4], const float extent[4], float *data);
+
 class VertexBufferObject
 {
 public:
@@ -54,7 +95,17 @@ public:
     GLuint rows;
     GLuint cols;
 
-    VertexBufferObject() : id(0), rows(0), cols(0) {}
+    // Incremented on every update, lets CPU side caches detect stale data
+    unsigned long revision;
+
+    // Format used by the next uploads, the attribute must be rebound after changing it
+    VertexFormat format;
+
+    // Per row origin and extent of the packed data, set by update
+    float origin[4];
+    float extent[4];
+
+    VertexBufferObject() : id(0), rows(0), cols(0), revision(0), format(FORMAT_FLOAT32) {}
 
     // Create a new empty VBO
     void init();
@@ -62,14 +113,57 @@ public:
     // Updates the VBO with a matrix M
     void update(const Eigen::MatrixXf& M);
 
+    // Updates the VBO with a column major rows x cols array of floats
+    void update(const float *data, GLuint rows, GLuint cols);
+
+    // Overwrites count columns starting at first, the size of the VBO is unchanged.
+    // Returns false without uploading if the data does not fit the UNORM16 range
+    // of the last update, the whole VBO must then be updated
+    bool updateColumns(const float *data, GLuint first, GLuint count);
+
+    // Number of components, type and normalization of the attribute
+    GLuint components() const;
+    GLuint bytesPerColumn() const;
+    GLenum type() const;
+    bool normalized() const;
+
+    // Transformation from the stored 2D positions to the original ones
+    Eigen::Matrix4f decode() const;
+
     // Select this VBO for subsequent draw calls
     void bind();
 
     // Release the id
     void free();
+
+private:
+    std::vector<unsigned char> packed;
 };
 
-// This class wraps an OpenGL program composed of two shaders
+class ElementBufferObject
+{
+public:
+    typedef unsigned int GLuint;
+
+    GLuint id;
+    GLuint size;
+
+    ElementBufferObject() : id(0), size(0) {}
+
+    // Create a new empty EBO
+    void init();
+
+    // Updates the EBO with the vertex indices I
+    void update(const std::vector<unsigned int>& I);
+
+    // Select this EBO for subsequent draw calls
+    void bind();
+
+    // Release the id
+    void free();
+};
+
+// This class wraps an OpenGL program composed of two shaders, and optionally a geometry shader
 class Program
 {
 public:
@@ -78,14 +172,39 @@ public:
 
   GLuint vertex_shader;
   GLuint fragment_shader;
+  GLuint geometry_shader;
   GLuint program_shader;
 
-  Program() : vertex_shader(0), fragment_shader(0), program_shader(0) { }
+  Program() : vertex_shader(0), fragment_shader(0), geometry_shader(0), program_shader(0), linking(false), link_cache(0) { }
 
-  // Create a new shader from the specified source strings
+  // Create a new shader from the specified source strings. The attributes
+  // listed in attribute_locations are bound to the locations 0,1,... so that
+  // programs sharing them can be used with the same VAOs. With a cache the
+  // program is linked from its stored binary when there is a valid one
   bool init(const std::string &vertex_shader_string,
   const std::string &fragment_shader_string,
-  const std::string &fragment_data_name);
+  const std::string &fragment_data_name,
+  const std::string &geometry_shader_string = "",
+  const std::vector<std::string> &attribute_locations = std::vector<std::string>(),
+  ProgramCache *cache = 0);
+
+  // Same as init() without waiting for the driver: the shaders are compiled
+  // and the program linked in the background by drivers that can, the errors
+  // are only reported by finish(). A program found in cache is ready at once
+  bool begin(const std::string &vertex_shader_string,
+  const std::string &fragment_shader_string,
+  const std::string &fragment_data_name,
+  const std::string &geometry_shader_string = "",
+  const std::vector<std::string> &attribute_locations = std::vector<std::string>(),
+  ProgramCache *cache = 0);
+
+  // Whether the link started by begin() is done, so that finish() does not
+  // block. The driver must support KHR_parallel_shader_compile
+  bool completed() const;
+
+  // Wait for the link started by begin() and check it. On a compile or link
+  // error the logs are printed and the program is released
+  bool finish();
 
   // Select this shader for subsequent draw calls
   void bind();
@@ -95,15 +214,28 @@ public:
 
   // Return the OpenGL handle of a named shader attribute (-1 if it does not exist)
   GLint attrib(const std::string &name) const;
+  GLint attrib(const char *name) const;
 
-  // Return the OpenGL handle of a uniform attribute (-1 if it does not exist)
+  // Return the OpenGL handle of a uniform attribute (-1 if it does not exist).
+  // The literal names of the draw calls do not build a std::string
   GLint uniform(const std::string &name) const;
+  GLint uniform(const char *name) const;
 
   // Bind a per-vertex array attribute
   GLint bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO) const;
 
+  // Bind an attribute made of components values found offset bytes into
+  // every stride bytes of an interleaved VBO
+  GLint bindVertexAttribArray(const std::string &name, VertexBufferObject& VBO,
+  GLuint components, GLuint stride, GLuint offset) const;
+
   GLuint create_shader_helper(GLint type, const std::string &shader_string);
 
+private:
+  bool linking;
+  std::string cache_key;
+  ProgramCache *link_cache;
+
 };
 
 // From: https://blog.nobel-joergensen.com/2013/01/29/debugging-opengl-using-glgeterror/
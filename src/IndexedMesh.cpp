@@ -0,0 +1,165 @@
+#include "IndexedMesh.h"
+#include "Geometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+void IndexedMesh::clear()
+{
+  V.resize(2, 0);
+  C.resize(3, 0);
+  vertex_count = 0;
+  I.clear();
+  references.clear();
+  cell_head.clear();
+  next_in_cell.clear();
+}
+
+long long IndexedMesh::cellCoord(float x) const
+{
+  return (long long) std::floor(x / weld_epsilon);
+}
+
+void IndexedMesh::link(unsigned int v)
+{
+  long long key = cellKey(cellCoord(V(0, v)), cellCoord(V(1, v)));
+  std::unordered_map<long long, unsigned int>::iterator head = cell_head.find(key);
+  next_in_cell[v] = head == cell_head.end() ? -1 : int(head->second);
+  cell_head[key] = v;
+}
+
+void IndexedMesh::unlink(unsigned int v)
+{
+  long long key = cellKey(cellCoord(V(0, v)), cellCoord(V(1, v)));
+  std::unordered_map<long long, unsigned int>::iterator head = cell_head.find(key);
+  if (head == cell_head.end())
+    return;
+  if (head->second == v)
+  {
+    if (next_in_cell[v] < 0)
+      cell_head.erase(head);
+    else
+      head->second = next_in_cell[v];
+    return;
+  }
+  for (int u = head->second; u >= 0; u = next_in_cell[u])
+  {
+    if (next_in_cell[u] == int(v))
+    {
+      next_in_cell[u] = next_in_cell[v];
+      return;
+    }
+  }
+}
+
+unsigned int IndexedMesh::addVertex(float x, float y, const Eigen::Vector3f &color)
+{
+  long long cx = cellCoord(x);
+  long long cy = cellCoord(y);
+  for (int dy = -1; dy <= 1; dy++)
+  {
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      std::unordered_map<long long, unsigned int>::const_iterator head = cell_head.find(cellKey(cx + dx, cy + dy));
+      if (head == cell_head.end())
+        continue;
+      for (int u = head->second; u >= 0; u = next_in_cell[u])
+        if (std::abs(V(0, u) - x) <= weld_epsilon && std::abs(V(1, u) - y) <= weld_epsilon)
+          return u;
+    }
+  }
+
+  // Grow the pool geometrically, columns past vertex_count are unused
+  if (vertex_count == V.cols())
+  {
+    unsigned int capacity = std::max(16u, 2 * vertex_count);
+    V.conservativeResize(2, capacity);
+    C.conservativeResize(3, capacity);
+  }
+  unsigned int v = vertex_count++;
+  V.col(v) << x, y;
+  C.col(v) = color;
+  next_in_cell.push_back(-1);
+  references.push_back(0);
+  link(v);
+  return v;
+}
+
+void IndexedMesh::addTriangle(const Eigen::MatrixXf &SV, const Eigen::MatrixXf &SC, unsigned int first)
+{
+  for (unsigned int i = 0; i < 3; i++)
+  {
+    unsigned int v = addVertex(SV(0, first+i), SV(1, first+i), SC.col(first+i));
+    references[v]++;
+    I.push_back(v);
+  }
+}
+
+void IndexedMesh::removeTriangle(unsigned int t)
+{
+  for (unsigned int i = 0; i < 3; i++)
+    references[I[3*t+i]]--;
+  I.erase(I.begin() + 3*t, I.begin() + 3*t + 3);
+}
+
+void IndexedMesh::fromSoup(const Eigen::MatrixXf &SV, const Eigen::MatrixXf &SC)
+{
+  clear();
+  I.reserve(SV.cols());
+  for (unsigned int first = 0; first + 2 < SV.cols(); first += 3)
+    addTriangle(SV, SC, first);
+}
+
+void IndexedMesh::toSoup(Eigen::MatrixXf &SV, Eigen::MatrixXf &SC) const
+{
+  SV.resize(2, I.size());
+  SC.resize(3, I.size());
+  for (unsigned int i = 0; i < I.size(); i++)
+  {
+    SV.col(i) = V.col(I[i]);
+    SC.col(i) = C.col(I[i]);
+  }
+}
+
+void IndexedMesh::moveVertex(unsigned int v, float x, float y)
+{
+  unlink(v);
+  V.col(v) << x, y;
+  link(v);
+}
+
+int IndexedMesh::nearestVertex(float x, float y, float radius) const
+{
+  int nearest = -1;
+  float nearDistance = radius * radius;
+  for (unsigned int v = 0; v < vertex_count; v++)
+  {
+    if (references[v] == 0)
+      continue;
+    float distance = (V.col(v) - Eigen::Vector2f(x, y)).squaredNorm();
+    if (distance <= nearDistance)
+    {
+      nearest = v;
+      nearDistance = distance;
+    }
+  }
+  return nearest;
+}
+
+int IndexedMesh::triangleAt(float x, float y) const
+{
+  for (int t = triangles() - 1; t >= 0; t--)
+    if (ptInTriangle(x, y, V(0, I[3*t]), V(1, I[3*t]), V(0, I[3*t+1]), V(1, I[3*t+1]), V(0, I[3*t+2]), V(1, I[3*t+2])))
+      return t;
+  return -1;
+}
+
+void IndexedMesh::edges(std::vector<unsigned int> &E) const
+{
+  E.resize(2 * I.size());
+  for (unsigned int t = 0; t < triangles(); t++)
+  {
+    unsigned int e[6] = {I[3*t], I[3*t+1], I[3*t+1], I[3*t+2], I[3*t+2], I[3*t]};
+    std::copy(e, e+6, E.begin() + 6*t);
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef INDEXED_MESH_H
+#define INDEXED_MESH_H
+
+#include <unordered_map>
+#include <vector>
+#include <Eigen/Core>
+
+// Triangles sharing a pool of welded vertices: every corner is an index
+// into the pool, so moving or recoloring a vertex shared by several
+// triangles is a single write
+class IndexedMesh
+{
+public:
+  // Vertex pool, only the first vertex_count columns are in use
+  Eigen::MatrixXf V;
+  Eigen::MatrixXf C;
+  unsigned int vertex_count;
+
+  // Three pool indices per triangle
+  std::vector<unsigned int> I;
+
+  // Number of triangle corners using each vertex of the pool
+  std::vector<unsigned int> references;
+
+  // Vertices closer than this are welded together when inserted
+  float weld_epsilon;
+
+  IndexedMesh() : vertex_count(0), weld_epsilon(1e-6f) {}
+
+  unsigned int triangles() const { return I.size() / 3; }
+
+  // Remove all the vertices and triangles
+  void clear();
+
+  // Return an existing vertex closer than weld_epsilon to (x,y), or a new one
+  unsigned int addVertex(float x, float y, const Eigen::Vector3f &color);
+
+  // Add the triangle stored in the columns first..first+2 of a triangle soup
+  void addTriangle(const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, unsigned int first);
+
+  // Remove a triangle, its vertices stay in the pool but are no longer
+  // found by nearestVertex once no triangle uses them
+  void removeTriangle(unsigned int t);
+
+  // Replace the mesh with a welded copy of a triangle soup
+  void fromSoup(const Eigen::MatrixXf &V, const Eigen::MatrixXf &C);
+
+  // Expand the mesh back to a triangle soup
+  void toSoup(Eigen::MatrixXf &V, Eigen::MatrixXf &C) const;
+
+  // Move a vertex, all the incident triangles follow
+  void moveVertex(unsigned int v, float x, float y);
+
+  // Nearest vertex used by a triangle within radius of (x,y), -1 if there is none
+  int nearestVertex(float x, float y, float radius) const;
+
+  // Triangle containing (x,y), topmost first, -1 if there is none
+  int triangleAt(float x, float y) const;
+
+  // Two indices per triangle edge, for drawing outlines with GL_LINES
+  void edges(std::vector<unsigned int> &E) const;
+
+private:
+  // Keys of distinct cells may collide, lookups always compare the actual positions
+  long long cellKey(long long x, long long y) const { return (long long) ((unsigned long long) x * 73856093ULL ^ (unsigned long long) y * 19349663ULL); }
+  long long cellCoord(float x) const;
+  void link(unsigned int v);
+  void unlink(unsigned int v);
+
+  // Hash grid with cells of weld_epsilon, each cell is a linked list of vertices
+  std::unordered_map<long long, unsigned int> cell_head;
+  std::vector<int> next_in_cell;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "Lod.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LodPyramid::build(const TriangleGrid& grid, const Eigen::MatrixXf& V, const Eigen::MatrixXf& C, const Eigen::Vector3f& background)
+{
+  unsigned int triangles = grid.triangle_bounds.size();
+  bounds = grid.bounds;
+
+  level_w.clear();
+  level_h.clear();
+  levels.clear();
+  if (triangles == 0)
+    return;
+
+  triangle_extent.resize(triangles);
+  for (unsigned int t = 0; t < triangles; t++)
+  {
+    const BoundingBox& b = grid.triangle_bounds[t];
+    triangle_extent[t] = std::max(b.max_x - b.min_x, b.max_y - b.min_y);
+  }
+
+  int w = grid.cells_x;
+  int h = grid.cells_y;
+  float width = std::max(bounds.max_x - bounds.min_x, 1e-6f);
+  float height = std::max(bounds.max_y - bounds.min_y, 1e-6f);
+
+  while (true)
+  {
+    level_w.push_back(w);
+    level_h.push_back(h);
+    levels.push_back(std::vector<LodCell>(w * h));
+    std::vector<LodCell>& cells = levels.back();
+    std::vector<float> area(w * h, 0.0f);
+
+    float cell_w = width / w;
+    float cell_h = height / h;
+    float size = std::max(cell_w, cell_h);
+
+    for (unsigned int t = 0; t < triangles; t++)
+    {
+      if (triangle_extent[t] >= size)
+        continue;
+
+      Eigen::Vector2f a = V.col(3*t), b = V.col(3*t+1), c = V.col(3*t+2);
+      Eigen::Vector2f centroid = (a + b + c) / 3;
+      int x = std::min(w - 1, std::max(0, int((centroid.x() - bounds.min_x) / cell_w)));
+      int y = std::min(h - 1, std::max(0, int((centroid.y() - bounds.min_y) / cell_h)));
+
+      float triangle_area = 0.5f * std::abs((b.x() - a.x()) * (c.y() - a.y()) - (c.x() - a.x()) * (b.y() - a.y()));
+      Eigen::Vector3f color = (C.col(3*t) + C.col(3*t+1) + C.col(3*t+2)) / 3;
+      cells[y * w + x].color += triangle_area * color;
+      area[y * w + x] += triangle_area;
+    }
+
+    for (int i = 0; i < w * h; i++)
+    {
+      if (area[i] <= 0)
+        continue;
+      float coverage = std::min(1.0f, area[i] / (cell_w * cell_h));
+      cells[i].coverage = coverage;
+      cells[i].color = coverage * (cells[i].color / area[i]) + (1 - coverage) * background;
+    }
+
+    if (w == 1 && h == 1)
+      break;
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+  }
+}
+
+float LodPyramid::cellSize(int level) const
+{
+  return std::max((bounds.max_x - bounds.min_x) / level_w[level], (bounds.max_y - bounds.min_y) / level_h[level]);
+}
+
+int LodPyramid::selectLevel(float pixels_per_unit, float max_cell_pixels) const
+{
+  int selected = -1;
+  for (unsigned int l = 0; l < levels.size(); l++)
+    if (cellSize(l) * pixels_per_unit <= max_cell_pixels)
+      selected = l;
+  return selected;
+}
+
+unsigned int LodPyramid::emitQuads(int level, const BoundingBox& box, FrameArena& arena, float*& QV, float*& QC) const
+{
+  QV = 0;
+  QC = 0;
+  if (level < 0 || level >= (int) levels.size())
+    return 0;
+
+  int w = level_w[level];
+  int h = level_h[level];
+  int x0, y0, x1, y1;
+  if (!gridCellRange(bounds, w, h, box, x0, y0, x1, y1))
+    return 0;
+  float cell_w = std::max(bounds.max_x - bounds.min_x, 1e-6f) / w;
+  float cell_h = std::max(bounds.max_y - bounds.min_y, 1e-6f) / h;
+
+  const std::vector<LodCell>& cells = levels[level];
+  unsigned int quads = 0;
+  for (int y = y0; y <= y1; y++)
+    for (int x = x0; x <= x1; x++)
+      if (cells[y * w + x].coverage > 0)
+        quads++;
+
+  QV = arena.allocate<float>(2 * 6 * quads);
+  QC = arena.allocate<float>(3 * 6 * quads);
+  Eigen::Map<Eigen::MatrixXf> positions(QV, 2, 6 * quads);
+  Eigen::Map<Eigen::MatrixXf> colors(QC, 3, 6 * quads);
+  unsigned int v = 0;
+  for (int y = y0; y <= y1; y++)
+  {
+    for (int x = x0; x <= x1; x++)
+    {
+      const LodCell& cell = cells[y * w + x];
+      if (cell.coverage <= 0)
+        continue;
+      float left = bounds.min_x + x * cell_w;
+      float bottom = bounds.min_y + y * cell_h;
+      float right = left + cell_w;
+      float top = bottom + cell_h;
+      positions.col(v)   << left, bottom;
+      positions.col(v+1) << right, bottom;
+      positions.col(v+2) << right, top;
+      positions.col(v+3) << left, bottom;
+      positions.col(v+4) << right, top;
+      positions.col(v+5) << left, top;
+      for (unsigned int i = 0; i < 6; i++)
+        colors.col(v+i) = cell.color;
+      v += 6;
+    }
+  }
+  return quads;
+}
@@ -0,0 +1,60 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+#include <Eigen/Core>
+
+#include "Culling.h"
+#include "FrameArena.h"
+
+// Pre-aggregated summary of the small triangles falling into one cell
+class LodCell
+{
+public:
+  // Area weighted average color of the triangles, blended with the
+  // background according to the covered fraction of the cell
+  Eigen::Vector3f color;
+  float coverage;
+
+  LodCell() : color(0, 0, 0), coverage(0) {}
+};
+
+// Hierarchy of coarser and coarser grids summarizing a triangle soup.
+// Level 0 has the resolution of the TriangleGrid, every following level
+// merges 2x2 cells. A triangle is aggregated into the cell containing its
+// centroid only on the levels whose cells are larger than the triangle,
+// bigger triangles are always drawn as they are.
+class LodPyramid
+{
+public:
+  // Revisions of the position and color VBOs the pyramid was built from
+  unsigned long revision;
+  unsigned long color_revision;
+
+  BoundingBox bounds;
+  std::vector<int> level_w;
+  std::vector<int> level_h;
+  std::vector<std::vector<LodCell> > levels;
+
+  // Largest side of the bounding box of each triangle
+  std::vector<float> triangle_extent;
+
+  LodPyramid() : revision(-1), color_revision(-1) {}
+
+  // Rebuild all levels from the positions V, the colors C and the grid built over V
+  void build(const TriangleGrid& grid, const Eigen::MatrixXf& V, const Eigen::MatrixXf& C, const Eigen::Vector3f& background);
+
+  // World space size of the cells of a level
+  float cellSize(int level) const;
+
+  // Coarsest level whose cells are at most max_cell_pixels wide on screen,
+  // -1 if even the finest level is larger and no aggregation is needed
+  int selectLevel(float pixels_per_unit, float max_cell_pixels) const;
+
+  // Write two triangles per non-empty cell of a level overlapping box into
+  // the positions QV (2 floats per vertex) and colors QC (3 floats per
+  // vertex) allocated from arena, returns the number of cells
+  unsigned int emitQuads(int level, const BoundingBox& box, FrameArena& arena, float*& QV, float*& QC) const;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "Picking.h"
+
+#include <iostream>
+
+namespace
+{
+  // Same position and depth as the frame programs, the triangle index is written 1-based
+  const char *id_vertex_shader =
+    "#version 150 core\n"
+    "in vec2 position;"
+    "in float layer;"
+    "uniform mat4 view;"
+    "flat out uint id;"
+    "void main()"
+    "{"
+    "    gl_Position = view * vec4(position, 0.0, 1.0);"
+    "    gl_Position.z = 1.0 - layer / 8388608.0;"
+    "    id = uint(gl_VertexID / 3 + 1);"
+    "}";
+
+  const char *id_fragment_shader =
+    "#version 150 core\n"
+    "flat in uint id;"
+    "out uint outId;"
+    "void main()"
+    "{"
+    "    outId = id;"
+    "}";
+}
+
+bool ObjectIdBuffer::init(const std::vector<std::string> &attributes)
+{
+  return program.init(id_vertex_shader, id_fragment_shader, "outId", "", attributes);
+}
+
+bool ObjectIdBuffer::current(unsigned long revision, float top_layer, const Eigen::Matrix4f &view, int width, int height) const
+{
+  return drawn && revision == this->revision && top_layer == this->top_layer && view == this->view && width == this->width && height == this->height;
+}
+
+void ObjectIdBuffer::resize(int width, int height)
+{
+  if (framebuffer && width == this->width && height == this->height)
+    return;
+  if (framebuffer)
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &ids);
+    glDeleteRenderbuffers(1, &depth);
+  }
+  this->width = width;
+  this->height = height;
+
+  glGenRenderbuffers(1, &ids);
+  glBindRenderbuffer(GL_RENDERBUFFER, ids);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, width, height);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  GLint previous;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ids);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "The object ID target is not supported" << std::endl;
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+  if (!pixel_buffer)
+  {
+    glGenBuffers(1, &pixel_buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLuint), 0, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+  check_gl_error();
+}
+
+Program &ObjectIdBuffer::begin(const Eigen::Matrix4f &view, int width, int height)
+{
+  GLint previous;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  target = previous;
+  resize(width, height);
+  this->view = view;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  const GLuint background[4] = {0, 0, 0, 0};
+  glClearBufferuiv(GL_COLOR, 0, background);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  program.bind();
+  glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
+  return program;
+}
+
+void ObjectIdBuffer::end(unsigned long revision, float top_layer)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  this->revision = revision;
+  this->top_layer = top_layer;
+  drawn = true;
+}
+
+void ObjectIdBuffer::request(int x, int y)
+{
+  if (!drawn || x < 0 || y < 0 || x >= width || y >= height)
+    return;
+  if (fence)
+    glDeleteSync(fence);
+
+  GLint previous;
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffer);
+  glReadPixels(x, y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+
+  // Flushed so that the copy completes even if nothing else is submitted
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+}
+
+bool ObjectIdBuffer::result(int &triangle, bool wait)
+{
+  if (!fence)
+    return false;
+  GLenum status = glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ULL : 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+    return false;
+  glDeleteSync(fence);
+  fence = 0;
+
+  GLuint id = 0;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffer);
+  const GLuint *mapped = (const GLuint *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(GLuint), GL_MAP_READ_BIT);
+  if (mapped)
+    id = *mapped;
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  triangle = int(id) - 1;
+  return true;
+}
+
+void ObjectIdBuffer::free()
+{
+  if (fence)
+    glDeleteSync(fence);
+  if (framebuffer)
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &ids);
+    glDeleteRenderbuffers(1, &depth);
+  }
+  if (pixel_buffer)
+    glDeleteBuffers(1, &pixel_buffer);
+  program.free();
+  fence = 0;
+  framebuffer = 0;
+  ids = 0;
+  depth = 0;
+  pixel_buffer = 0;
+  drawn = false;
+}
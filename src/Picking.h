@@ -0,0 +1,68 @@
+#ifndef PICKING_H
+#define PICKING_H
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "Helpers.h"
+
+// Integer target holding at every pixel the index of the triangle drawn
+// there, with the depth test of the frame so that the topmost one wins. It
+// is drawn again only when the scene or the view changed, a pixel is then
+// read back without stalling: request() queues the copy into a pixel buffer
+// and result() returns it once the GPU is done
+class ObjectIdBuffer
+{
+public:
+  typedef unsigned int GLuint;
+
+  int width;
+  int height;
+
+  ObjectIdBuffer() : width(0), height(0), revision(0), top_layer(0), drawn(false), framebuffer(0), ids(0), depth(0), pixel_buffer(0), fence(0), target(0) {}
+
+  // Compile the program with the attributes bound to the locations of the
+  // frame programs, false if the driver cannot
+  bool init(const std::vector<std::string> &attributes);
+
+  // Whether the buffer shows the scene at revision and top_layer seen through view
+  bool current(unsigned long revision, float top_layer, const Eigen::Matrix4f &view, int width, int height) const;
+
+  // Redirect the drawing to the cleared target with the ID program bound.
+  // The vertex i of the draws belongs to the triangle i / 3
+  Program &begin(const Eigen::Matrix4f &view, int width, int height);
+
+  // Restore the previous framebuffer, the buffer is then current for revision and top_layer
+  void end(unsigned long revision, float top_layer);
+
+  // Start reading the triangle at the pixel (x, y) from the bottom left,
+  // replacing a request whose result was not taken
+  void request(int x, int y);
+
+  // Whether a request is waiting for its result
+  bool pending() const { return fence != 0; }
+
+  // The triangle at the requested pixel, -1 for none. False while the GPU
+  // has not copied it yet, unless wait is set
+  bool result(int &triangle, bool wait);
+
+  void free();
+
+private:
+  unsigned long revision;
+  float top_layer;
+  Eigen::Matrix4f view;
+  bool drawn;
+  GLuint framebuffer;
+  GLuint ids;
+  GLuint depth;
+  GLuint pixel_buffer;
+  GLsync fence;
+  GLuint target;                 // Framebuffer bound before begin()
+  Program program;
+
+  void resize(int width, int height);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "Poster.h"
+
+#include <iostream>
+
+Eigen::Matrix4f PosterTiling::view(int column, int row) const
+{
+  // Normalized device coordinates of the tile, y going up
+  float left = 2.0f * column * side / width - 1;
+  float right = 2.0f * (column + 1) * side / width - 1;
+  float top = 1 - 2.0f * row * side / height;
+  float bottom = 1 - 2.0f * (row + 1) * side / height;
+
+  Eigen::Matrix4f m = Eigen::Matrix4f::Identity();
+  m(0, 0) = 2 / (right - left);
+  m(1, 1) = 2 / (top - bottom);
+  m(0, 3) = -(right + left) / (right - left);
+  m(1, 3) = -(top + bottom) / (top - bottom);
+  return m;
+}
+
+bool PpmStream::open(const std::string &path, int width, int height)
+{
+  close();
+  file = fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    std::cerr << "Cannot write " << path << std::endl;
+    return false;
+  }
+  this->width = width;
+  remaining = height;
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  return true;
+}
+
+bool PpmStream::write(const unsigned char *rgb, int rows)
+{
+  if (!file || rows > remaining)
+    return false;
+  remaining -= rows;
+  return fwrite(rgb, 3 * size_t(width), rows, file) == size_t(rows);
+}
+
+bool PpmStream::close()
+{
+  if (!file)
+    return true;
+  bool ok = remaining == 0 && !ferror(file);
+  ok = fclose(file) == 0 && ok;
+  file = 0;
+  return ok;
+}
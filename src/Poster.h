@@ -0,0 +1,49 @@
+#ifndef POSTER_H
+#define POSTER_H
+
+#include <cstdio>
+#include <string>
+
+#include <Eigen/Core>
+
+// Split of a poster of width x height pixels into square tiles of side
+// pixels, the last column and row of tiles reach past the poster
+struct PosterTiling
+{
+  int width;
+  int height;
+  int side;
+
+  PosterTiling(int width, int height, int side) : width(width), height(height), side(side) {}
+
+  int columns() const { return (width + side - 1) / side; }
+  int rows() const { return (height + side - 1) / side; }
+
+  // Projection enlarging the part of the normalized device coordinates shown
+  // by a tile to the whole viewport. Rows are counted from the top
+  Eigen::Matrix4f view(int column, int row) const;
+};
+
+// Binary PPM written one band of rows at a time from the top, so that the
+// image never has to fit in memory
+class PpmStream
+{
+public:
+  PpmStream() : file(0), width(0), remaining(0) {}
+  ~PpmStream() { close(); }
+
+  bool open(const std::string &path, int width, int height);
+
+  // Append rows of 3 * width bytes each
+  bool write(const unsigned char *rgb, int rows);
+
+  // False if a write failed or rows are missing
+  bool close();
+
+private:
+  FILE *file;
+  int width;
+  int remaining;
+};
+
+#endif
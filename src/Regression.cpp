@@ -0,0 +1,280 @@
+#include "Regression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <GLFW/glfw3.h>
+
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <sys/stat.h>
+#endif
+
+bool readPPM(const std::string &path, Image &image)
+{
+  using namespace std;
+  ifstream in(path.c_str(), ios::binary);
+  string magic;
+  int maximum = 0;
+  if (!(in >> magic >> image.width >> image.height >> maximum) || magic != "P6" || maximum != 255 || image.width <= 0 || image.height <= 0)
+    return false;
+  in.get();
+  image.rgb.resize(3 * image.width * image.height);
+  return bool(in.read((char *) &image.rgb[0], image.rgb.size()));
+}
+
+bool writePPM(const std::string &path, const Image &image)
+{
+  using namespace std;
+  ofstream out(path.c_str(), ios::binary);
+  out << "P6\n" << image.width << " " << image.height << "\n255\n";
+  if (!image.rgb.empty())
+    out.write((const char *) &image.rgb[0], image.rgb.size());
+  return bool(out);
+}
+
+void createDirectory(const std::string &path)
+{
+#ifdef _WIN32
+  _mkdir(path.c_str());
+#else
+  mkdir(path.c_str(), 0755);
+#endif
+}
+
+unsigned int differingPixels(const Image &a, const Image &b, int tolerance, Image *diff)
+{
+  if (a.width != b.width || a.height != b.height)
+    return std::max(a.width * a.height, b.width * b.height);
+  if (diff)
+  {
+    diff->width = a.width;
+    diff->height = a.height;
+    diff->rgb.assign(a.rgb.size(), 0);
+  }
+  unsigned int count = 0;
+  for (unsigned int p = 0; p < a.rgb.size() / 3; p++)
+  {
+    bool differs = false;
+    for (unsigned int c = 0; c < 3; c++)
+      differs = differs || std::abs(int(a.rgb[3*p+c]) - int(b.rgb[3*p+c])) > tolerance;
+    if (differs)
+      count++;
+    if (diff)
+    {
+      // The differences in red over the dimmed expected image
+      diff->rgb[3*p] = differs ? 255 : a.rgb[3*p] / 4;
+      diff->rgb[3*p+1] = differs ? 0 : a.rgb[3*p+1] / 4;
+      diff->rgb[3*p+2] = differs ? 0 : a.rgb[3*p+2] / 4;
+    }
+  }
+  return count;
+}
+
+void ImageTarget::init(int width, int height)
+{
+  free();
+  this->width = width;
+  this->height = height;
+
+  glGenRenderbuffers(1, &color);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "The regression framebuffer is not supported" << std::endl;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  check_gl_error();
+}
+
+void ImageTarget::bind()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, width, height);
+}
+
+void ImageTarget::read(Image &image)
+{
+  image.width = width;
+  image.height = height;
+  image.rgb.resize(3 * width * height);
+  std::vector<unsigned char> rows(3 * width * height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rows[0]);
+  for (int y = 0; y < height; y++)
+    memcpy(&image.rgb[3 * width * y], &rows[3 * width * (height - 1 - y)], 3 * width);
+  check_gl_error();
+}
+
+void ImageTarget::free()
+{
+  if (framebuffer)
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color);
+    glDeleteRenderbuffers(1, &depth);
+    framebuffer = 0;
+    color = 0;
+    depth = 0;
+  }
+}
+
+FrameStats FrameStats::of(std::vector<double> ms)
+{
+  FrameStats stats;
+  stats.frames = ms.size();
+  if (ms.empty())
+    return stats;
+  std::sort(ms.begin(), ms.end());
+  for (unsigned int i = 0; i < ms.size(); i++)
+    stats.mean_ms += ms[i] / ms.size();
+  stats.median_ms = ms[ms.size() / 2];
+  stats.p95_ms = ms[std::min(ms.size() - 1, (size_t) (0.95 * ms.size()))];
+  stats.max_ms = ms.back();
+  return stats;
+}
+
+bool writeFrameStats(const std::string &path, const SceneTimes &times)
+{
+  using namespace std;
+  ofstream out(path.c_str());
+  out << "{\n";
+  for (unsigned int i = 0; i < times.size(); i++)
+  {
+    const FrameStats &s = times[i].second;
+    out << "  \"" << times[i].first << "\": {\"frames\": " << s.frames << ", \"mean_ms\": " << s.mean_ms << ", \"median_ms\": " << s.median_ms
+        << ", \"p95_ms\": " << s.p95_ms << ", \"max_ms\": " << s.max_ms << "}" << (i + 1 < times.size() ? "," : "") << "\n";
+  }
+  out << "}\n";
+  return bool(out);
+}
+
+namespace
+{
+  double member(const std::string &object, const std::string &name)
+  {
+    size_t at = object.find("\"" + name + "\":");
+    return at == std::string::npos ? 0 : atof(object.c_str() + at + name.size() + 3);
+  }
+}
+
+bool readFrameStats(const std::string &path, std::map<std::string, FrameStats> &times)
+{
+  using namespace std;
+  ifstream in(path.c_str());
+  if (!in)
+    return false;
+  string line;
+  while (getline(in, line))
+  {
+    // One scene per line: "name": {...}
+    size_t open = line.find('"'), close = line.find('"', open + 1), brace = line.find('{');
+    if (open == string::npos || close == string::npos || brace == string::npos || brace < close)
+      continue;
+    string object = line.substr(brace);
+    FrameStats &s = times[line.substr(open + 1, close - open - 1)];
+    s.frames = (unsigned int) member(object, "frames");
+    s.mean_ms = member(object, "mean_ms");
+    s.median_ms = member(object, "median_ms");
+    s.p95_ms = member(object, "p95_ms");
+    s.max_ms = member(object, "max_ms");
+  }
+  return true;
+}
+
+namespace
+{
+  InputEvent key(int code)
+  {
+    InputEvent event(InputEvent::KEY);
+    event.key = code;
+    event.action = GLFW_PRESS;
+    return event;
+  }
+
+  InputEvent move(double x, double y)
+  {
+    InputEvent event(InputEvent::CURSOR_POSITION);
+    event.x = x;
+    event.y = y;
+    return event;
+  }
+
+  InputEvent button(int action, double x, double y)
+  {
+    InputEvent event(InputEvent::MOUSE_BUTTON);
+    event.key = GLFW_MOUSE_BUTTON_LEFT;
+    event.action = action;
+    event.x = x;
+    event.y = y;
+    return event;
+  }
+
+  // Move to the point, press and release the left button
+  void click(std::vector<InputEvent> &events, double x, double y)
+  {
+    events.push_back(move(x, y));
+    events.push_back(button(GLFW_PRESS, x, y));
+    events.push_back(button(GLFW_RELEASE, x, y));
+  }
+}
+
+std::vector<RegressionScene> canonicalScenes()
+{
+  std::vector<RegressionScene> scenes(5);
+
+  // Three triangles, the last one over the first two
+  RegressionScene &insert = scenes[0];
+  insert.name = "insert";
+  insert.events.push_back(key(GLFW_KEY_I));
+  const double corners[9][2] = {{100, 100}, {300, 100}, {200, 300}, {350, 150}, {550, 150}, {450, 400}, {150, 250}, {400, 250}, {275, 450}};
+  for (unsigned int i = 0; i < 9; i++)
+    click(insert.events, corners[i][0], corners[i][1]);
+
+  // Drag the first triangle, rotate it, then release it with a click elsewhere
+  RegressionScene &translate = scenes[1];
+  translate.name = "translate";
+  translate.events.push_back(key(GLFW_KEY_O));
+  translate.events.push_back(move(200, 170));
+  translate.events.push_back(button(GLFW_PRESS, 200, 170));
+  translate.events.push_back(move(230, 190));
+  translate.events.push_back(move(260, 210));
+  translate.events.push_back(button(GLFW_RELEASE, 260, 210));
+  translate.events.push_back(key(GLFW_KEY_H));
+  click(translate.events, 620, 20);
+
+  // Blue first vertex of the second triangle
+  RegressionScene &recolor = scenes[2];
+  recolor.name = "recolor";
+  recolor.events.push_back(key(GLFW_KEY_C));
+  click(recolor.events, 352, 152);
+  recolor.events.push_back(key(GLFW_KEY_3));
+
+  // Delete the third triangle
+  RegressionScene &remove = scenes[3];
+  remove.name = "delete";
+  remove.events.push_back(key(GLFW_KEY_P));
+  click(remove.events, 275, 400);
+
+  // Scale animation stopped in the middle of the second triangle
+  RegressionScene &animation = scenes[4];
+  animation.name = "animation";
+  animation.events.push_back(key(GLFW_KEY_Z));
+  animation.steps = 16;
+
+  return scenes;
+}
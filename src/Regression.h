@@ -0,0 +1,100 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Helpers.h"
+#include "EventQueue.h"
+
+// 8-bit RGB image, rows from the top
+struct Image
+{
+  int width;
+  int height;
+  std::vector<unsigned char> rgb;
+
+  Image() : width(0), height(0) {}
+};
+
+// Binary PPM (P6) files, readable by most image viewers
+bool readPPM(const std::string &path, Image &image);
+bool writePPM(const std::string &path, const Image &image);
+
+// Create the directory if it does not exist
+void createDirectory(const std::string &path);
+
+// Number of pixels with a channel differing by more than tolerance, all of
+// them if the sizes differ. diff, if given, shows the differing pixels in red
+unsigned int differingPixels(const Image &a, const Image &b, int tolerance, Image *diff = 0);
+
+// Single sampled framebuffer the regression frames are drawn into, so that
+// they can be read back whether or not the window is visible
+class ImageTarget
+{
+public:
+  typedef unsigned int GLuint;
+
+  ImageTarget() : width(0), height(0), framebuffer(0), color(0), depth(0) {}
+
+  void init(int width, int height);
+
+  // Draw into the target, the antialiasing resolves into it
+  void bind();
+
+  // Copy the colors into image, flipped to rows from the top
+  void read(Image &image);
+
+  void free();
+
+private:
+  int width;
+  int height;
+  GLuint framebuffer;
+  GLuint color;
+  GLuint depth;
+};
+
+// Frame time statistics of a scene
+struct FrameStats
+{
+  unsigned int frames;
+  double mean_ms;
+  double median_ms;
+  double p95_ms;
+  double max_ms;
+
+  FrameStats() : frames(0), mean_ms(0), median_ms(0), p95_ms(0), max_ms(0) {}
+
+  static FrameStats of(std::vector<double> ms);
+};
+
+typedef std::vector<std::pair<std::string, FrameStats> > SceneTimes;
+
+// JSON object with one member per scene, as written by writeFrameStats.
+// readFrameStats only parses that format
+bool writeFrameStats(const std::string &path, const SceneTimes &times);
+bool readFrameStats(const std::string &path, std::map<std::string, FrameStats> &times);
+
+// Scripted input of a canonical scene: the events are replayed one per frame
+// in a window of regressionWidth x regressionHeight, then the animation is
+// stepped by steps keyframes. The scenes run in order, each one starting
+// from the state the previous one left
+struct RegressionScene
+{
+  std::string name;
+  std::vector<InputEvent> events;
+  unsigned int steps;
+
+  RegressionScene() : steps(0) {}
+};
+
+const int regressionWidth = 640;
+const int regressionHeight = 480;
+
+// Insertion, translation, recoloring, deletion and animation of triangles
+std::vector<RegressionScene> canonicalScenes();
+
+#endif
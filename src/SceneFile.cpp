@@ -0,0 +1,288 @@
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace
+{
+  const char scene_magic[4] = {'R', 'S', 'C', 'N'};
+  const unsigned int scene_version = 1;
+  const size_t header_size = 16;
+}
+
+bool writeSceneFile(const std::string &path, const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, unsigned int triangles_per_chunk)
+{
+  using namespace std;
+  unsigned int triangles = V.cols() / 3;
+
+  BoundingBox bounds;
+  for (unsigned int i = 0; i < 3 * triangles; i++)
+    bounds.extend(V(0, i), V(1, i));
+
+  // Bucket the triangles by centroid into a square grid of chunks
+  int side = max(1, int(ceil(sqrt(double(triangles) / max(1u, triangles_per_chunk)))));
+  float cell_w = max(bounds.max_x - bounds.min_x, 1e-6f) / side;
+  float cell_h = max(bounds.max_y - bounds.min_y, 1e-6f) / side;
+  vector<vector<unsigned int> > buckets(side * side);
+  for (unsigned int t = 0; t < triangles; t++)
+  {
+    float cx = (V(0, 3*t) + V(0, 3*t+1) + V(0, 3*t+2)) / 3;
+    float cy = (V(1, 3*t) + V(1, 3*t+1) + V(1, 3*t+2)) / 3;
+    int x = min(side - 1, max(0, int((cx - bounds.min_x) / cell_w)));
+    int y = min(side - 1, max(0, int((cy - bounds.min_y) / cell_h)));
+    buckets[y * side + x].push_back(t);
+  }
+
+  vector<SceneChunk> chunks;
+  vector<unsigned int> chunk_bucket;
+  unsigned long long offset = 0;
+  for (unsigned int b = 0; b < buckets.size(); b++)
+  {
+    if (buckets[b].empty())
+      continue;
+    SceneChunk chunk;
+    chunk.vertices = 3 * buckets[b].size();
+    chunk.reserved = 0;
+    for (unsigned int i = 0; i < buckets[b].size(); i++)
+      for (unsigned int k = 0; k < 3; k++)
+        chunk.bounds.extend(V(0, 3*buckets[b][i]+k), V(1, 3*buckets[b][i]+k));
+    chunk.offset = offset;
+    offset += chunk.bytes();
+    chunks.push_back(chunk);
+    chunk_bucket.push_back(b);
+  }
+  unsigned long long payload = header_size + sizeof(SceneChunk) * chunks.size();
+  for (unsigned int c = 0; c < chunks.size(); c++)
+    chunks[c].offset += payload;
+
+  ofstream out(path.c_str(), ios::binary);
+  if (!out)
+  {
+    cerr << "Cannot write scene file " << path << endl;
+    return false;
+  }
+  unsigned int header[3] = {scene_version, (unsigned int) chunks.size(), 0};
+  out.write(scene_magic, 4);
+  out.write((const char *) header, sizeof(header));
+  if (!chunks.empty())
+    out.write((const char *) &chunks[0], sizeof(SceneChunk) * chunks.size());
+
+  vector<float> buffer;
+  for (unsigned int c = 0; c < chunks.size(); c++)
+  {
+    const vector<unsigned int> &bucket = buckets[chunk_bucket[c]];
+    buffer.resize(5 * chunks[c].vertices);
+    float *positions = &buffer[0];
+    float *colors = positions + 2 * chunks[c].vertices;
+    for (unsigned int i = 0; i < bucket.size(); i++)
+    {
+      for (unsigned int k = 0; k < 3; k++)
+      {
+        unsigned int v = 3*bucket[i]+k;
+        unsigned int j = 3*i+k;
+        positions[2*j] = V(0, v);
+        positions[2*j+1] = V(1, v);
+        colors[3*j] = C(0, v);
+        colors[3*j+1] = C(1, v);
+        colors[3*j+2] = C(2, v);
+      }
+    }
+    out.write((const char *) &buffer[0], sizeof(float) * buffer.size());
+  }
+  return bool(out);
+}
+
+bool MappedSceneFile::open(const std::string &path)
+{
+  using namespace std;
+  close();
+
+#ifdef _WIN32
+  HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_handle == INVALID_HANDLE_VALUE)
+  {
+    cerr << "Cannot open scene file " << path << endl;
+    return false;
+  }
+  LARGE_INTEGER file_size;
+  GetFileSizeEx(file_handle, &file_size);
+  handle = file_handle;
+  size = file_size.QuadPart;
+  mapping = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+  data = mapping ? (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    cerr << "Cannot open scene file " << path << endl;
+    return false;
+  }
+  struct stat info;
+  fstat(fd, &info);
+  size = info.st_size;
+  void *address = size ? mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  ::close(fd);
+  data = address == MAP_FAILED ? 0 : (const char *) address;
+#endif
+
+  if (!data || size < header_size || memcmp(data, scene_magic, 4) != 0)
+  {
+    cerr << "Invalid scene file " << path << endl;
+    close();
+    return false;
+  }
+
+  unsigned int header[3];
+  memcpy(header, data + 4, sizeof(header));
+  if (header[0] != scene_version || header_size + sizeof(SceneChunk) * header[1] > size)
+  {
+    cerr << "Unsupported scene file " << path << endl;
+    close();
+    return false;
+  }
+  chunks.resize(header[1]);
+  if (!chunks.empty())
+    memcpy(&chunks[0], data + header_size, sizeof(SceneChunk) * chunks.size());
+  for (unsigned int c = 0; c < chunks.size(); c++)
+  {
+    if (chunks[c].offset + chunks[c].bytes() > size)
+    {
+      cerr << "Truncated scene file " << path << endl;
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void MappedSceneFile::close()
+{
+#ifdef _WIN32
+  if (data)
+    UnmapViewOfFile(data);
+  if (mapping)
+    CloseHandle(mapping);
+  if (handle)
+    CloseHandle(handle);
+#else
+  if (data)
+    munmap((void *) data, size);
+#endif
+  data = 0;
+  size = 0;
+  handle = 0;
+  mapping = 0;
+  chunks.clear();
+}
+
+const float *MappedSceneFile::positions(unsigned int chunk) const
+{
+  return (const float *) (data + chunks[chunk].offset);
+}
+
+const float *MappedSceneFile::colors(unsigned int chunk) const
+{
+  return positions(chunk) + 2 * chunks[chunk].vertices;
+}
+
+void ChunkCache::init(const MappedSceneFile *file, size_t budget)
+{
+  free();
+  this->file = file;
+  this->budget = budget;
+  slots.resize(file->chunks.size());
+}
+
+bool ChunkCache::load(Program &program, unsigned int chunk, unsigned long frame)
+{
+  size_t bytes = file->chunks[chunk].bytes();
+
+  // Make room, but never evict a chunk that is drawn in this frame
+  while (resident_bytes + bytes > budget && !lru.empty() && slots[lru.back()].last_frame != frame)
+    evict(lru.back());
+  if (resident_bytes + bytes > budget)
+    return false;
+
+  ResidentChunk &slot = slots[chunk];
+  slot.VAO.init();
+  slot.VAO.bind();
+  slot.VBO.init();
+  slot.VBO.update(file->positions(chunk), 2, file->chunks[chunk].vertices);
+  slot.VBO_C.init();
+  slot.VBO_C.update(file->colors(chunk), 3, file->chunks[chunk].vertices);
+  program.bindVertexAttribArray("position", slot.VBO);
+  program.bindVertexAttribArray("color", slot.VBO_C);
+
+  slot.resident = true;
+  lru.push_front(chunk);
+  slot.lru = lru.begin();
+  resident_bytes += bytes;
+  loads++;
+  return true;
+}
+
+void ChunkCache::evict(unsigned int chunk)
+{
+  ResidentChunk &slot = slots[chunk];
+  slot.VAO.free();
+  slot.VBO.free();
+  slot.VBO_C.free();
+  slot.resident = false;
+  lru.erase(slot.lru);
+  resident_bytes -= file->chunks[chunk].bytes();
+  evictions++;
+}
+
+void ChunkCache::draw(Program &program, const BoundingBox &box, const BoundingBox &visible, unsigned long frame)
+{
+  drawn = 0;
+  if (!file)
+    return;
+
+  // Touched first so that the loads below do not evict a chunk still on screen
+  for (unsigned int c = 0; c < slots.size(); c++)
+  {
+    ResidentChunk &slot = slots[c];
+    if (slot.resident && file->chunks[c].bounds.overlaps(visible))
+    {
+      lru.splice(lru.begin(), lru, slot.lru);
+      slot.last_frame = frame;
+    }
+  }
+
+  for (unsigned int c = 0; c < slots.size(); c++)
+  {
+    if (!file->chunks[c].bounds.overlaps(box))
+      continue;
+
+    ResidentChunk &slot = slots[c];
+    if (!slot.resident && !load(program, c, frame))
+    {
+      misses++;
+      continue;
+    }
+    slot.last_frame = frame;
+
+    slot.VAO.bind();
+    glDrawArrays(GL_TRIANGLES, 0, file->chunks[c].vertices);
+    drawn++;
+  }
+}
+
+void ChunkCache::free()
+{
+  while (!lru.empty())
+    evict(lru.back());
+  slots.clear();
+  file = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "Helpers.h"
+#include "Culling.h"
+
+// A scene file starts with a 16 bytes header (magic "RSCN", version, number
+// of chunks, reserved) followed by the chunk table and by the payload of
+// every chunk: its positions (2 floats per vertex) then its colors (3 floats
+// per vertex). Triangles are bucketed into chunks by centroid, so the
+// painting order is only preserved inside a chunk.
+class SceneChunk
+{
+public:
+  BoundingBox bounds;
+  unsigned long long offset;  // Byte offset of the payload in the file
+  unsigned int vertices;
+  unsigned int reserved;
+
+  // GPU memory used by the chunk once resident
+  size_t bytes() const { return size_t(vertices) * 5 * sizeof(float); }
+};
+
+// Write the triangle soup V, C as a scene file with chunks of about triangles_per_chunk triangles
+bool writeSceneFile(const std::string &path, const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, unsigned int triangles_per_chunk = 65536);
+
+// Read-only memory mapping of a scene file
+class MappedSceneFile
+{
+public:
+  std::vector<SceneChunk> chunks;
+
+  MappedSceneFile() : data(0), size(0), handle(0), mapping(0) {}
+
+  // Map the file and read its chunk table
+  bool open(const std::string &path);
+
+  // Unmap the file
+  void close();
+
+  // Positions and colors of a chunk, paged in on access
+  const float *positions(unsigned int chunk) const;
+  const float *colors(unsigned int chunk) const;
+
+private:
+  const char *data;
+  size_t size;
+  void *handle;
+  void *mapping;
+};
+
+// GPU buffers of a chunk while it is resident
+class ResidentChunk
+{
+public:
+  VertexArrayObject VAO;
+  VertexBufferObject VBO;
+  VertexBufferObject VBO_C;
+  bool resident;
+  unsigned long last_frame;
+  std::list<unsigned int>::iterator lru;
+
+  ResidentChunk() : resident(false), last_frame(0) {}
+};
+
+// Keeps the chunks of a mapped scene file resident on the GPU within a
+// memory budget, evicting the least recently drawn ones first
+class ChunkCache
+{
+public:
+  size_t budget;
+  size_t resident_bytes;
+  unsigned long loads;
+  unsigned long evictions;
+  unsigned long misses;      // Visible chunks skipped because the budget was exhausted
+  unsigned int drawn;        // Chunks drawn in the last frame
+
+  ChunkCache() : budget(0), resident_bytes(0), loads(0), evictions(0), misses(0), drawn(0), file(0) {}
+
+  // Serve the chunks of file within budget bytes of GPU memory
+  void init(const MappedSceneFile *file, size_t budget);
+
+  // Load the chunks overlapping box if needed and draw them. The resident
+  // chunks overlapping visible, the whole view, are kept as recently used
+  // even when a partial redraw does not draw them
+  void draw(Program &program, const BoundingBox &box, const BoundingBox &visible, unsigned long frame);
+
+  // Release all the resident chunks
+  void free();
+
+private:
+  bool load(Program &program, unsigned int chunk, unsigned long frame);
+  void evict(unsigned int chunk);
+
+  const MappedSceneFile *file;
+  std::vector<ResidentChunk> slots;
+  std::list<unsigned int> lru;   // Most recently used first
+};
+
+#endif
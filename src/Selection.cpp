@@ -0,0 +1,192 @@
+#include "Selection.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace
+{
+  // Triangles below which the transform is not worth a thread
+  const unsigned int triangles_per_thread = 16384;
+
+  Eigen::Vector2f centroid_of(const Eigen::MatrixXf& V, unsigned int t)
+  {
+    return (V.col(3*t) + V.col(3*t+1) + V.col(3*t+2)) / 3;
+  }
+
+  // Crossing number test of the point p against the closed polygon P
+  bool inside(const Eigen::MatrixXf& P, const Eigen::Vector2f& p)
+  {
+    bool in = false;
+    for (int i = 0, j = P.cols() - 1; i < P.cols(); j = i++)
+    {
+      float xi = P(0, i), yi = P(1, i), xj = P(0, j), yj = P(1, j);
+      if ((yi > p.y()) != (yj > p.y()) && p.x() < (xj - xi) * (p.y() - yi) / (yj - yi) + xi)
+        in = !in;
+    }
+    return in;
+  }
+
+  // Transform the triangles of the runs from the first'th selected one on, count triangles in total
+  void transform_part(Eigen::MatrixXf& V, const std::vector<TriangleRun>& runs, const Eigen::Matrix4f& transform, unsigned int first, unsigned int count)
+  {
+    float a = transform(0, 0), b = transform(0, 1), c = transform(1, 0), d = transform(1, 1);
+    float tx = transform(0, 3), ty = transform(1, 3);
+    for (unsigned int r = 0; r < runs.size() && count > 0; r++)
+    {
+      if (first >= runs[r].second)
+      {
+        first -= runs[r].second;
+        continue;
+      }
+      unsigned int n = std::min(runs[r].second - first, count);
+
+      // Plain loop over the interleaved x,y pairs, which the compiler vectorizes
+      float* p = V.data() + 6 * (runs[r].first + first);
+      for (unsigned int i = 0; i < 3 * n; i++)
+      {
+        float x = p[2*i], y = p[2*i+1];
+        p[2*i] = a * x + b * y + tx;
+        p[2*i+1] = c * x + d * y + ty;
+      }
+      count -= n;
+      first = 0;
+    }
+  }
+}
+
+void Selection::resize(unsigned int n)
+{
+  if (n < triangles)
+  {
+    for (unsigned int t = n; t < triangles; t++)
+      if (contains(t))
+        count--;
+    bits.resize((n + 63) / 64);
+    if (n % 64)
+      bits.back() &= (1ULL << (n % 64)) - 1;
+  }
+  else
+  {
+    bits.resize((n + 63) / 64, 0);
+  }
+  triangles = n;
+}
+
+void Selection::clear()
+{
+  std::fill(bits.begin(), bits.end(), 0);
+  count = 0;
+}
+
+bool Selection::contains(unsigned int t) const
+{
+  return t < triangles && (bits[t / 64] >> (t % 64) & 1);
+}
+
+void Selection::add(unsigned int t)
+{
+  if (t >= triangles)
+    resize(t + 1);
+  if (!contains(t))
+  {
+    bits[t / 64] |= 1ULL << (t % 64);
+    count++;
+  }
+}
+
+unsigned int Selection::addBox(TriangleGrid& grid, const Eigen::MatrixXf& V, const BoundingBox& box)
+{
+  std::vector<unsigned int> candidates;
+  grid.query(box, candidates);
+  unsigned int before = count;
+  for (unsigned int i = 0; i < candidates.size(); i++)
+  {
+    Eigen::Vector2f c = centroid_of(V, candidates[i]);
+    if (c.x() >= box.min_x && c.x() <= box.max_x && c.y() >= box.min_y && c.y() <= box.max_y)
+      add(candidates[i]);
+  }
+  return count - before;
+}
+
+unsigned int Selection::addLasso(TriangleGrid& grid, const Eigen::MatrixXf& V, const Eigen::MatrixXf& P)
+{
+  if (P.cols() < 3)
+    return 0;
+  BoundingBox box;
+  for (int i = 0; i < P.cols(); i++)
+    box.extend(P(0, i), P(1, i));
+  std::vector<unsigned int> candidates;
+  grid.query(box, candidates);
+  unsigned int before = count;
+  for (unsigned int i = 0; i < candidates.size(); i++)
+    if (inside(P, centroid_of(V, candidates[i])))
+      add(candidates[i]);
+  return count - before;
+}
+
+void Selection::runs(std::vector<TriangleRun>& runs, unsigned int max_gap) const
+{
+  runs.clear();
+  unsigned int start = 0, end = 0;
+  bool open = false;
+  for (unsigned int w = 0; w < bits.size(); w++)
+  {
+    // Empty words are skipped at once
+    if (bits[w] == 0)
+      continue;
+    for (unsigned int b = 0; b < 64; b++)
+    {
+      if (!(bits[w] >> b & 1))
+        continue;
+      unsigned int t = 64 * w + b;
+      if (open && t - end <= max_gap)
+      {
+        end = t + 1;
+        continue;
+      }
+      if (open)
+        runs.push_back(TriangleRun(start, end - start));
+      start = t;
+      end = t + 1;
+      open = true;
+    }
+  }
+  if (open)
+    runs.push_back(TriangleRun(start, end - start));
+}
+
+Eigen::Vector2f Selection::centroid(const Eigen::MatrixXf& V) const
+{
+  std::vector<TriangleRun> selected;
+  runs(selected);
+  Eigen::Vector2f sum(0, 0);
+  for (unsigned int r = 0; r < selected.size(); r++)
+    sum += V.middleCols(3 * selected[r].first, 3 * selected[r].second).rowwise().sum();
+  return count > 0 ? Eigen::Vector2f(sum / (3.0f * count)) : sum;
+}
+
+void transformRuns(Eigen::MatrixXf& V, const std::vector<TriangleRun>& runs, const Eigen::Matrix4f& transform)
+{
+  unsigned int total = 0;
+  for (unsigned int r = 0; r < runs.size(); r++)
+    total += runs[r].second;
+
+  unsigned int threads = std::max(1u, std::min(std::thread::hardware_concurrency(), total / triangles_per_thread));
+  if (threads == 1)
+  {
+    transform_part(V, runs, transform, 0, total);
+    return;
+  }
+
+  // Every thread takes an equal share of the selected triangles, whatever the runs
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < threads; i++)
+  {
+    unsigned int first = (unsigned long long) total * i / threads;
+    unsigned int last = (unsigned long long) total * (i + 1) / threads;
+    workers.push_back(std::thread(transform_part, std::ref(V), std::cref(runs), std::cref(transform), first, last - first));
+  }
+  for (unsigned int i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
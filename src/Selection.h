@@ -0,0 +1,55 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <utility>
+#include <vector>
+#include <Eigen/Core>
+
+#include "Culling.h"
+
+// Run of consecutive triangles: first triangle, number of triangles
+typedef std::pair<unsigned int, unsigned int> TriangleRun;
+
+// Set of selected triangles of a triangle soup, one bit per triangle
+class Selection
+{
+public:
+  // Number of selected triangles
+  unsigned int count;
+
+  Selection() : count(0), triangles(0) {}
+
+  bool empty() const { return count == 0; }
+
+  // Track n triangles, the new ones are not selected
+  void resize(unsigned int n);
+
+  void clear();
+
+  bool contains(unsigned int t) const;
+
+  void add(unsigned int t);
+
+  // Add the triangles of V whose centroid lies in box, returns how many were added
+  unsigned int addBox(TriangleGrid& grid, const Eigen::MatrixXf& V, const BoundingBox& box);
+
+  // Add the triangles of V whose centroid lies in the closed polygon P (one vertex per column)
+  unsigned int addLasso(TriangleGrid& grid, const Eigen::MatrixXf& V, const Eigen::MatrixXf& P);
+
+  // Runs of selected triangles in order. Runs separated by at most max_gap
+  // unselected triangles are merged, the merged run then covers these too
+  void runs(std::vector<TriangleRun>& runs, unsigned int max_gap = 0) const;
+
+  // Mean of the vertices of the selected triangles
+  Eigen::Vector2f centroid(const Eigen::MatrixXf& V) const;
+
+private:
+  std::vector<unsigned long long> bits;
+  unsigned int triangles;
+};
+
+// Apply the affine transform to the vertices of the runs of triangles of V.
+// Large selections are split over the hardware threads
+void transformRuns(Eigen::MatrixXf& V, const std::vector<TriangleRun>& runs, const Eigen::Matrix4f& transform);
+
+#endif
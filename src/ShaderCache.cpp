@@ -0,0 +1,167 @@
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <sys/stat.h>
+#endif
+
+namespace
+{
+  const char binary_magic[4] = {'P', 'B', 'I', 'N'};
+
+  // FNV-1a, the parts are separated by a zero byte so that moving text
+  // from one part to the next changes the hash
+  unsigned long long hash_parts(const std::vector<std::string> &parts)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    for (unsigned int p = 0; p < parts.size(); p++)
+    {
+      for (unsigned int i = 0; i <= parts[p].size(); i++)
+      {
+        h ^= (unsigned char) parts[p].c_str()[i];
+        h *= 1099511628211ULL;
+      }
+    }
+    return h;
+  }
+
+  std::string gl_string(GLenum name)
+  {
+    const GLubyte *s = glGetString(name);
+    return s ? std::string((const char *) s) : std::string();
+  }
+
+  // Discard the errors of a rejected binary, the program is compiled instead
+  void clear_gl_errors()
+  {
+    while (glGetError() != GL_NO_ERROR)
+      ;
+  }
+}
+
+bool ProgramCache::init(const std::string &directory)
+{
+  supported = false;
+  if (directory.empty())
+    return false;
+
+#ifndef __APPLE__
+  if (!GLEW_ARB_get_program_binary)
+    return false;
+#endif
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  clear_gl_errors();
+  if (formats <= 0)
+    return false;
+
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+  this->directory = directory;
+  driver = gl_string(GL_VENDOR) + "\n" + gl_string(GL_RENDERER) + "\n" + gl_string(GL_VERSION) + "\n" + gl_string(GL_SHADING_LANGUAGE_VERSION);
+  supported = true;
+  return true;
+}
+
+std::string ProgramCache::key(const std::vector<std::string> &parts) const
+{
+  std::vector<std::string> all(parts);
+  all.push_back(driver);
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", hash_parts(all));
+  return name;
+}
+
+std::string ProgramCache::path(const std::string &key) const
+{
+  return directory + "/" + key + ".bin";
+}
+
+bool ProgramCache::load(GLuint program, const std::string &key)
+{
+  using namespace std;
+  if (!supported)
+    return false;
+
+  ifstream in(path(key).c_str(), ios::binary);
+  char magic[4];
+  unsigned int header[2];
+  if (!in.read(magic, 4) || memcmp(magic, binary_magic, 4) != 0 || !in.read((char *) header, sizeof(header)))
+    return false;
+
+  // The length is checked against the file before allocating, a corrupt one could be anything
+  streampos start = in.tellg();
+  in.seekg(0, ios::end);
+  streampos end = in.tellg();
+  if (start < 0 || end < 0 || header[1] == 0 || (unsigned long long) (end - start) < header[1])
+    return false;
+  in.seekg(start);
+  vector<char> binary(header[1]);
+  if (!in.read(&binary[0], binary.size()))
+    return false;
+
+  glProgramBinary(program, header[0], &binary[0], binary.size());
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  clear_gl_errors();
+  return status == GL_TRUE;
+}
+
+void ProgramCache::store(GLuint program, const std::string &key)
+{
+  using namespace std;
+  if (!supported)
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+  {
+    clear_gl_errors();
+    return;
+  }
+  vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, &binary[0]);
+  if (glGetError() != GL_NO_ERROR)
+  {
+    clear_gl_errors();
+    return;
+  }
+
+  // Concurrent instances write their own temporary file and rename it, a
+  // reader never sees a partly written binary
+  string target = path(key);
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%llx.tmp", (unsigned long long) chrono::steady_clock::now().time_since_epoch().count());
+  string temporary = target + suffix;
+  {
+    ofstream out(temporary.c_str(), ios::binary);
+    unsigned int header[2] = {(unsigned int) format, (unsigned int) length};
+    out.write(binary_magic, 4);
+    out.write((const char *) header, sizeof(header));
+    out.write(&binary[0], length);
+    if (!out)
+    {
+      cerr << "Cannot write program binary " << temporary << endl;
+      out.close();
+      remove(temporary.c_str());
+      return;
+    }
+  }
+#ifdef _WIN32
+  remove(target.c_str());
+#endif
+  if (rename(temporary.c_str(), target.c_str()) != 0)
+    remove(temporary.c_str());
+}
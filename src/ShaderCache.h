@@ -0,0 +1,58 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "Helpers.h"
+
+// On-disk cache of linked program binaries. A program is stored under a hash
+// of its sources, its bound names and the vendor/renderer/version strings of
+// the driver, so an edited shader or an updated driver misses the cache and
+// the program is compiled again
+class ProgramCache
+{
+public:
+  typedef unsigned int GLuint;
+
+  // Programs linked from the cache, compiled from their sources, and the
+  // time spent in Program::init with this cache. Atomic since the variants
+  // compiled in the background count from their worker thread
+  std::atomic<unsigned int> hits;
+  std::atomic<unsigned int> misses;
+  std::atomic<double> init_ms;
+
+  ProgramCache() : hits(0), misses(0), init_ms(0), supported(false) {}
+
+  // Store the binaries in directory, created if missing. Needs a current
+  // context, returns false if the driver cannot save program binaries
+  bool init(const std::string &directory);
+
+  bool enabled() const { return supported; }
+
+  void addInitTime(double ms)
+  {
+    double current = init_ms.load();
+    while (!init_ms.compare_exchange_weak(current, current + ms)) {}
+  }
+
+  // Key of a program made of the given sources and names on this driver
+  std::string key(const std::vector<std::string> &parts) const;
+
+  // Link program from the binary stored under key. A missing, truncated or
+  // rejected binary returns false without error, the program is then compiled
+  bool load(GLuint program, const std::string &key);
+
+  // Save the binary of the linked program under key
+  void store(GLuint program, const std::string &key);
+
+private:
+  std::string directory;
+  std::string driver;
+  bool supported;
+
+  std::string path(const std::string &key) const;
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "ShaderVariants.h"
+#include "ShaderCache.h"
+
+#include <iostream>
+#include <GLFW/glfw3.h>
+
+namespace
+{
+  // The variants differ by the #defines inserted after the #version line.
+  // EDGE_DISTANCE adds the geometry shader computing the signed distance in
+  // pixels of every corner to the three edges, interpolated without
+  // perspective it is the distance of each fragment to the edges
+  const char *vertex_source =
+    "in vec2 position;\n"
+    "uniform mat4 view;\n"
+    "in vec3 color;\n"
+    "in float alpha;\n"
+    "in float layer;\n"
+    "#ifdef EDGE_DISTANCE\n"
+    "#define f_color g_color\n"
+    "#endif\n"
+    "out vec3 f_color;\n"
+    "out float f_alpha;\n"
+    "#ifdef WEIGHTED_OIT\n"
+    "uniform float topLayer;\n"
+    "out float f_order;\n"
+    "#endif\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = view * vec4(position, 0.0, 1.0);\n"
+    "    gl_Position.z = 1.0 - layer / 8388608.0;\n"
+    "    f_color = color;\n"
+    "    f_alpha = alpha;\n"
+    "#ifdef WEIGHTED_OIT\n"
+    "    f_order = layer / topLayer;\n"
+    "#endif\n"
+    "}\n";
+
+  // For the analytic antialiasing the triangle is grown by one pixel and
+  // the distance gives the pixel coverage
+  const char *geometry_source =
+    "layout(triangles) in;\n"
+    "layout(triangle_strip, max_vertices = 3) out;\n"
+    "in vec3 g_color[];\n"
+    "uniform vec2 viewport;\n"
+    "out vec3 f_color;\n"
+    "noperspective out vec3 f_edge;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 p[3];\n"
+    "    for (int i = 0; i < 3; i++)\n"
+    "        p[i] = 0.5 * viewport * gl_in[i].gl_Position.xy / gl_in[i].gl_Position.w;\n"
+    "    float orientation = sign((p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x));\n"
+    "    vec2 n[3];\n"
+    "    for (int i = 0; i < 3; i++)\n"
+    "    {\n"
+    "        vec2 e = p[(i+2)%3] - p[(i+1)%3];\n"
+    "        n[i] = orientation * vec2(-e.y, e.x) / max(length(e), 1e-6);\n"
+    "    }\n"
+    "    for (int i = 0; i < 3; i++)\n"
+    "    {\n"
+    "#ifdef EDGE_ANTIALIASING\n"
+    "        vec2 a = n[(i+1)%3];\n"
+    "        vec2 b = n[(i+2)%3];\n"
+    "        vec2 q = p[i] - (a + b) / max(1.0 + dot(a, b), 0.25);\n"
+    "#else\n"
+    "        vec2 q = p[i];\n"
+    "#endif\n"
+    "        gl_Position = vec4(q / (0.5 * viewport) * gl_in[i].gl_Position.w, gl_in[i].gl_Position.zw);\n"
+    "        f_color = g_color[i];\n"
+    "        f_edge = vec3(dot(n[0], q - p[1]), dot(n[1], q - p[2]), dot(n[2], q - p[0]));\n"
+    "        EmitVertex();\n"
+    "    }\n"
+    "    EndPrimitive();\n"
+    "}\n";
+
+  // The weighted blended transparency writes the two accumulation targets,
+  // the weight grows with the layer relative to the top one
+  const char *fragment_source =
+    "in vec3 f_color;\n"
+    "#ifdef EDGE_DISTANCE\n"
+    "noperspective in vec3 f_edge;\n"
+    "#else\n"
+    "in float f_alpha;\n"
+    "#endif\n"
+    "#ifdef OUTLINE\n"
+    "uniform float outlineWidth;\n"
+    "uniform vec3 outlineColor;\n"
+    "#endif\n"
+    "#ifdef WEIGHTED_OIT\n"
+    "in float f_order;\n"
+    "out vec4 outColor[2];\n"
+    "#else\n"
+    "out vec4 outColor;\n"
+    "#endif\n"
+    "void main()\n"
+    "{\n"
+    "#if defined(WEIGHTED_OIT)\n"
+    "    float weight = f_alpha * clamp(10.0 * pow(f_order, 3.0), 0.01, 10.0);\n"
+    "    outColor[0] = vec4(f_color * f_alpha * weight, f_alpha);\n"
+    "    outColor[1] = vec4(f_alpha * weight);\n"
+    "#elif defined(EDGE_DISTANCE)\n"
+    "    float distance = min(f_edge.x, min(f_edge.y, f_edge.z));\n"
+    "    vec3 color = f_color;\n"
+    "#if defined(OUTLINE_SMOOTH)\n"
+    "    color = mix(outlineColor, f_color, smoothstep(outlineWidth - 0.5, outlineWidth + 0.5, distance));\n"
+    "#elif defined(OUTLINE)\n"
+    "    color = mix(outlineColor, f_color, step(outlineWidth, distance));\n"
+    "#endif\n"
+    "#ifdef EDGE_ANTIALIASING\n"
+    "    outColor = vec4(color, clamp(distance + 0.5, 0.0, 1.0));\n"
+    "#else\n"
+    "    outColor = vec4(color, 1.0);\n"
+    "#endif\n"
+    "#else\n"
+    "    outColor = vec4(f_color, f_alpha);\n"
+    "#endif\n"
+    "}\n";
+
+  const char *feature_names[4] = {"OUTLINE", "OUTLINE_SMOOTH", "EDGE_ANTIALIASING", "WEIGHTED_OIT"};
+
+  bool edge_distance(unsigned int features)
+  {
+    return (features & (SHADER_OUTLINE | SHADER_EDGE_ANTIALIASING)) && !(features & SHADER_WEIGHTED_OIT);
+  }
+
+  std::string header(unsigned int features)
+  {
+    std::string defines = "#version 150 core\n";
+    for (unsigned int i = 0; i < 4; i++)
+      if (features & (1u << i))
+        defines += std::string("#define ") + feature_names[i] + "\n";
+    if (edge_distance(features))
+      defines += "#define EDGE_DISTANCE\n";
+    return defines;
+  }
+
+  // Start building the variant, complete with finish()
+  bool begin_variant(Program &program, unsigned int features, const std::vector<std::string> &attributes, ProgramCache *cache)
+  {
+    std::string defines = header(features);
+    std::string geometry = edge_distance(features) ? defines + geometry_source : std::string();
+    return program.begin(defines + vertex_source, defines + fragment_source, "outColor", geometry, attributes, cache);
+  }
+
+  void report_failure(unsigned int features)
+  {
+    std::cerr << "Shader variant " << ShaderVariants::name(features) << " is not available" << std::endl;
+  }
+
+  typedef void (APIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+}
+
+void ShaderVariants::init(const std::vector<std::string> &attributes, ProgramCache *cache)
+{
+  this->attributes = attributes;
+  this->cache = cache;
+}
+
+ShaderVariants::Mode ShaderVariants::startParallel(GLFWwindow *window)
+{
+  // The driver compiles on its own threads, the link status is polled
+  const char *extensions[2] = {"GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile"};
+  const char *functions[2] = {"glMaxShaderCompilerThreadsKHR", "glMaxShaderCompilerThreadsARB"};
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    if (!glfwExtensionSupported(extensions[i]))
+      continue;
+    MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc) glfwGetProcAddress(functions[i]);
+    if (maxThreads)
+    {
+      maxThreads(0xFFFFFFFF);
+      mode = PARALLEL_DRIVER;
+      return mode;
+    }
+  }
+
+  // Otherwise a thread builds them in a hidden context sharing the objects of the window
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  background = glfwCreateWindow(1, 1, "", NULL, window);
+  glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+  if (!background)
+    return mode;
+  mode = BACKGROUND_CONTEXT;
+  stopping = false;
+  worker = std::thread(&ShaderVariants::work, this);
+  return mode;
+}
+
+void ShaderVariants::submit(unsigned int features, Variant &variant)
+{
+  if (mode == BACKGROUND_CONTEXT)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queued.push_back(features);
+    changed.notify_all();
+    return;
+  }
+
+  // The link status is only asked when the program is needed, or by poll()
+  if (!begin_variant(variant.program, features, attributes, cache))
+  {
+    variant.state = FAILED;
+    report_failure(features);
+  }
+  else if (mode == SYNCHRONOUS)
+  {
+    complete(variant, variant.program, features);
+  }
+}
+
+void ShaderVariants::complete(Variant &variant, const Program &program, unsigned int features)
+{
+  variant.program = program;
+  if (variant.program.finish())
+  {
+    variant.state = READY;
+    return;
+  }
+  variant.state = FAILED;
+  report_failure(features);
+}
+
+Program &ShaderVariants::get(unsigned int features)
+{
+  request(features);
+  Variant &variant = variants[features];
+  if (variant.state != BUILDING)
+    return variant.program;
+
+  if (mode == BACKGROUND_CONTEXT)
+  {
+    while (variant.state == BUILDING)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return !finished.empty(); });
+      }
+      poll();
+    }
+    return variant.program;
+  }
+  complete(variant, variant.program, features);
+  return variant.program;
+}
+
+Program *ShaderVariants::request(unsigned int features)
+{
+  std::map<unsigned int, Variant>::iterator found = variants.find(features);
+  if (found == variants.end())
+  {
+    found = variants.insert(std::make_pair(features, Variant())).first;
+    submit(features, found->second);
+  }
+  return found->second.state == READY ? &found->second.program : NULL;
+}
+
+bool ShaderVariants::available(unsigned int features)
+{
+  request(features);
+  return variants[features].state != FAILED;
+}
+
+bool ShaderVariants::poll()
+{
+  bool ready = false;
+  if (mode == PARALLEL_DRIVER)
+  {
+    for (std::map<unsigned int, Variant>::iterator i = variants.begin(); i != variants.end(); ++i)
+    {
+      if (i->second.state != BUILDING || !i->second.program.completed())
+        continue;
+      complete(i->second, i->second.program, i->first);
+      ready = ready || i->second.state == READY;
+    }
+  }
+  else if (mode == BACKGROUND_CONTEXT)
+  {
+    std::vector<std::pair<unsigned int, Program> > done;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done.swap(finished);
+    }
+    for (unsigned int i = 0; i < done.size(); i++)
+    {
+      // The worker checked the link, finish() only reads the result
+      complete(variants[done[i].first], done[i].second, done[i].first);
+      ready = ready || variants[done[i].first].state == READY;
+    }
+  }
+  return ready;
+}
+
+void ShaderVariants::work()
+{
+  glfwMakeContextCurrent(background);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    changed.wait(lock, [this]() { return stopping || !queued.empty(); });
+    if (stopping)
+      break;
+    unsigned int features = queued.front();
+    queued.pop_front();
+    lock.unlock();
+
+    // Wait here for the compile, the whole link is done before the program
+    // is handed to the thread drawing with it
+    Program program;
+    if (begin_variant(program, features, attributes, cache) && !program.finish())
+      program = Program();
+    glFinish();
+
+    lock.lock();
+    finished.push_back(std::make_pair(features, program));
+    changed.notify_all();
+  }
+  lock.unlock();
+  glfwMakeContextCurrent(NULL);
+}
+
+unsigned int ShaderVariants::building() const
+{
+  unsigned int count = 0;
+  for (std::map<unsigned int, Variant>::const_iterator i = variants.begin(); i != variants.end(); ++i)
+    if (i->second.state == BUILDING)
+      count++;
+  return count;
+}
+
+unsigned int ShaderVariants::linked() const
+{
+  unsigned int count = 0;
+  for (std::map<unsigned int, Variant>::const_iterator i = variants.begin(); i != variants.end(); ++i)
+    if (i->second.state == READY)
+      count++;
+  return count;
+}
+
+std::string ShaderVariants::name(unsigned int features)
+{
+  std::string names;
+  for (unsigned int i = 0; i < 4; i++)
+  {
+    if (!(features & (1u << i)))
+      continue;
+    if (!names.empty())
+      names += "+";
+    names += feature_names[i];
+  }
+  return names.empty() ? "plain" : names;
+}
+
+void ShaderVariants::free()
+{
+  if (worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      changed.notify_all();
+    }
+    worker.join();
+  }
+  if (background)
+  {
+    glfwDestroyWindow(background);
+    background = 0;
+  }
+  for (unsigned int i = 0; i < finished.size(); i++)
+    finished[i].second.free();
+  finished.clear();
+  queued.clear();
+  for (std::map<unsigned int, Variant>::iterator i = variants.begin(); i != variants.end(); ++i)
+    i->second.program.free();
+  variants.clear();
+  mode = SYNCHRONOUS;
+}
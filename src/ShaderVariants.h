@@ -0,0 +1,110 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Helpers.h"
+
+class ProgramCache;
+struct GLFWwindow;
+
+// Features of the triangle shader. Each one is a #define of the generated
+// sources, so a variant only contains the code of the features it has
+enum ShaderFeature
+{
+  SHADER_OUTLINE = 1 << 0,             // Edges shaded with outlineColor up to outlineWidth pixels
+  SHADER_OUTLINE_SMOOTH = 1 << 1,      // Antialiased outline border, with SHADER_OUTLINE
+  SHADER_EDGE_ANTIALIASING = 1 << 2,   // Triangles grown by a pixel, the alpha is the edge coverage
+  SHADER_WEIGHTED_OIT = 1 << 3         // Accumulation targets of WeightedBlendedOit
+};
+
+// Programs of the triangle shader for combinations of ShaderFeature flags.
+// A variant is generated and linked the first time it is asked for, the
+// plain variant (no flag) is the one of the points, lines and LOD cells.
+//
+// After startParallel() the variants are built without blocking the caller:
+// by the driver threads with KHR_parallel_shader_compile, otherwise by a
+// thread owning a hidden context shared with the window. request() returns
+// null until the variant is ready and the draw uses a fallback meanwhile
+class ShaderVariants
+{
+public:
+  enum Mode { SYNCHRONOUS, PARALLEL_DRIVER, BACKGROUND_CONTEXT };
+
+  Mode mode;
+
+  ShaderVariants() : mode(SYNCHRONOUS), cache(0), background(0), stopping(false) {}
+
+  // The attributes are bound to the same locations in every variant so
+  // that they share the VAOs. The linked programs go through cache if set
+  void init(const std::vector<std::string> &attributes, ProgramCache *cache = 0);
+
+  // Build the next variants in parallel. Call on the main thread with the
+  // context of window current, as it may create the hidden shared context
+  Mode startParallel(GLFWwindow *window);
+
+  // Program of the variant, linked on first use. Waits for a variant still
+  // being built. It has no program_shader if the driver failed to build it,
+  // the failure is not retried
+  Program &get(unsigned int features);
+
+  // Program of the variant if it is ready, otherwise null after starting
+  // its build if needed. Never blocks in the parallel modes
+  Program *request(unsigned int features);
+
+  // Whether the variant is ready or still being built, a failed one is not
+  bool available(unsigned int features);
+
+  // Collect the variants finished since the last call, returns true if
+  // any became ready. Call on the thread drawing with them
+  bool poll();
+
+  // Number of variants being built
+  unsigned int building() const;
+
+  // Number of variants ready
+  unsigned int linked() const;
+
+  // Names of the flags of a variant, "plain" without any
+  static std::string name(unsigned int features);
+
+  // Stop the background thread and release the programs. Call on the main
+  // thread, which destroys the hidden context
+  void free();
+
+private:
+  enum State { BUILDING, READY, FAILED };
+
+  struct Variant
+  {
+    Program program;
+    State state;
+    Variant() : state(BUILDING) {}
+  };
+
+  std::vector<std::string> attributes;
+  ProgramCache *cache;
+  std::map<unsigned int, Variant> variants;
+
+  // Background context: the queued features and the programs built from them
+  GLFWwindow *background;
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<unsigned int> queued;
+  std::vector<std::pair<unsigned int, Program> > finished;
+  bool stopping;
+
+  void submit(unsigned int features, Variant &variant);
+  void complete(Variant &variant, const Program &program, unsigned int features);
+  void work();
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "SvgExport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+  // Pixel coordinates from the scene: x' = a[0] x + a[1] y + a[2], y' = a[3] x + a[4] y + a[5]
+  void picture_transform(const SvgOptions &options, float *a)
+  {
+    const Eigen::Matrix4f &m = options.view;
+    float sx = 0.5f * options.width, sy = -0.5f * options.height;
+    a[0] = sx * m(0, 0);
+    a[1] = sx * m(0, 1);
+    a[2] = sx * (m(0, 3) + 1);
+    a[3] = sy * m(1, 0);
+    a[4] = sy * m(1, 1);
+    a[5] = sy * (m(1, 3) - 1);
+  }
+
+  void append_unsigned(std::string &out, unsigned long long value)
+  {
+    char digits[20];
+    int n = 0;
+    do
+    {
+      digits[n++] = char('0' + value % 10);
+      value /= 10;
+    } while (value);
+    while (n)
+      out += digits[--n];
+  }
+
+  // Two decimals without trailing zeros, printf would dominate the export. The far away
+  // vertices of partly visible triangles are clamped, rounding them would overflow
+  void append_number(std::string &out, float value)
+  {
+    long long hundredths = llroundf(std::min(1e9f, std::max(-1e9f, value)) * 100);
+    if (hundredths < 0)
+    {
+      out += '-';
+      hundredths = -hundredths;
+    }
+    append_unsigned(out, hundredths / 100);
+    int fraction = int(hundredths % 100);
+    if (fraction)
+    {
+      out += '.';
+      out += char('0' + fraction / 10);
+      if (fraction % 10)
+        out += char('0' + fraction % 10);
+    }
+  }
+
+  void append_color(std::string &out, float r, float g, float b)
+  {
+    const char hex[] = "0123456789abcdef";
+    float rgb[3] = {r, g, b};
+    out += '#';
+    for (int k = 0; k < 3; k++)
+    {
+      int c = int(std::min(std::max(rgb[k], 0.0f), 1.0f) * 255 + 0.5f);
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    }
+  }
+
+  void encode_chunk(const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, const SvgOptions &options, const float *a,
+                    unsigned int first, unsigned int count, std::string &out, unsigned long long &written)
+  {
+    out.clear();
+    written = 0;
+    for (unsigned int i = first; i < first + count; i++)
+    {
+      unsigned int t = options.order ? (*options.order)[i] : i;
+      float x[3], y[3];
+      for (int k = 0; k < 3; k++)
+      {
+        x[k] = a[0] * V(0, 3*t+k) + a[1] * V(1, 3*t+k) + a[2];
+        y[k] = a[3] * V(0, 3*t+k) + a[4] * V(1, 3*t+k) + a[5];
+      }
+      if (std::max(std::max(x[0], x[1]), x[2]) < 0 || std::min(std::min(x[0], x[1]), x[2]) > options.width ||
+          std::max(std::max(y[0], y[1]), y[2]) < 0 || std::min(std::min(y[0], y[1]), y[2]) > options.height)
+        continue;
+
+      out += "<path d=\"M";
+      for (int k = 0; k < 3; k++)
+      {
+        if (k)
+          out += 'L';
+        append_number(out, x[k]);
+        out += ' ';
+        append_number(out, y[k]);
+      }
+      out += "z\" fill=\"";
+      Eigen::Vector3f color = (C.col(3*t) + C.col(3*t+1) + C.col(3*t+2)) / 3;
+      append_color(out, color.x(), color.y(), color.z());
+      out += '"';
+      if (options.alpha)
+      {
+        float alpha = ((*options.alpha)(0, 3*t) + (*options.alpha)(0, 3*t+1) + (*options.alpha)(0, 3*t+2)) / 3;
+        if (alpha < 0.995f)
+        {
+          out += " fill-opacity=\"";
+          append_number(out, std::max(alpha, 0.0f));
+          out += '"';
+        }
+      }
+      out += "/>\n";
+      written++;
+    }
+  }
+}
+
+bool writeSvg(const std::string &path, const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, const SvgOptions &options, SvgStats *stats)
+{
+  using namespace std;
+  auto start = chrono::steady_clock::now();
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+  {
+    cerr << "Cannot write " << path << endl;
+    return false;
+  }
+  vector<char> file_buffer(1 << 20);
+  setvbuf(file, &file_buffer[0], _IOFBF, file_buffer.size());
+
+  string header = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+  append_unsigned(header, options.width);
+  header += "\" height=\"";
+  append_unsigned(header, options.height);
+  header += "\" viewBox=\"0 0 ";
+  append_unsigned(header, options.width);
+  header += ' ';
+  append_unsigned(header, options.height);
+  header += "\">\n<rect width=\"100%\" height=\"100%\" fill=\"";
+  append_color(header, options.background.x(), options.background.y(), options.background.z());
+  header += "\"/>\n<g stroke=\"none\">\n";
+  fwrite(header.data(), 1, header.size(), file);
+  unsigned long long bytes = header.size(), triangles = 0;
+
+  float a[6];
+  picture_transform(options, a);
+  unsigned int total = options.order ? options.order->size() : V.cols() / 3;
+  unsigned int per_chunk = max(1u, options.triangles_per_chunk);
+  unsigned int chunks = (total + per_chunk - 1) / per_chunk;
+  unsigned int threads = options.threads ? options.threads : max(1u, thread::hardware_concurrency());
+  unsigned int batches = (chunks + threads - 1) / threads;
+
+  // A batch of chunks is encoded while the previous one is written, in two sets of buffers
+  vector<string> buffers[2] = {vector<string>(threads), vector<string>(threads)};
+  vector<unsigned long long> written[2] = {vector<unsigned long long>(threads), vector<unsigned long long>(threads)};
+  for (unsigned int b = 0; b <= batches; b++)
+  {
+    vector<thread> workers;
+    for (unsigned int i = 0; b < batches && i < threads && b * threads + i < chunks; i++)
+    {
+      unsigned int first = (b * threads + i) * per_chunk;
+      unsigned int count = min(per_chunk, total - first);
+      workers.push_back(thread(encode_chunk, cref(V), cref(C), cref(options), a, first, count, ref(buffers[b % 2][i]), ref(written[b % 2][i])));
+    }
+    if (b > 0)
+    {
+      vector<string> &previous = buffers[(b - 1) % 2];
+      for (unsigned int i = 0; i < threads && (b - 1) * threads + i < chunks; i++)
+      {
+        fwrite(previous[i].data(), 1, previous[i].size(), file);
+        bytes += previous[i].size();
+        triangles += written[(b - 1) % 2][i];
+      }
+    }
+    for (unsigned int i = 0; i < workers.size(); i++)
+      workers[i].join();
+  }
+
+  const char footer[] = "</g>\n</svg>\n";
+  fwrite(footer, 1, sizeof(footer) - 1, file);
+  bytes += sizeof(footer) - 1;
+  bool ok = !ferror(file);
+  ok = fclose(file) == 0 && ok;
+  if (!ok)
+    cerr << "Cannot write " << path << endl;
+  if (stats)
+  {
+    stats->triangles = triangles;
+    stats->bytes = bytes;
+    stats->ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  }
+  return ok;
+}
@@ -0,0 +1,40 @@
+#ifndef SVG_EXPORT_H
+#define SVG_EXPORT_H
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+// How writeSvg places and paints the triangles
+struct SvgOptions
+{
+  int width;                                // Size of the picture, the viewport is mapped onto it
+  int height;
+  Eigen::Matrix4f view;                     // Scene to normalized device coordinates
+  Eigen::Vector3f background;
+  const Eigen::MatrixXf *alpha;             // Opacity of the vertices, opaque if null
+  const std::vector<unsigned int> *order;   // Triangles back to front, the soup order if null
+  unsigned int triangles_per_chunk;
+  unsigned int threads;                     // Encoding threads, 0 for one per core
+
+  SvgOptions() : width(640), height(480), view(Eigen::Matrix4f::Identity()), background(1, 1, 1), alpha(0), order(0), triangles_per_chunk(16384), threads(0) {}
+};
+
+// Counters of the last writeSvg
+struct SvgStats
+{
+  unsigned long long triangles;   // Triangles written, the ones outside the picture are skipped
+  unsigned long long bytes;
+  double ms;
+
+  SvgStats() : triangles(0), bytes(0), ms(0) {}
+};
+
+// Write the triangle soup V, C as an SVG picture, one path per triangle filled
+// with the average color of its vertices. The chunks of triangles are encoded
+// to text in parallel and written in order while the next ones are encoded, so
+// the memory used does not depend on the size of the scene
+bool writeSvg(const std::string &path, const Eigen::MatrixXf &V, const Eigen::MatrixXf &C, const SvgOptions &options, SvgStats *stats = 0);
+
+#endif
@@ -0,0 +1,457 @@
+#include "TextImport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace
+{
+  const size_t chunk_bytes = 1 << 20;
+
+  // Read-only mapping of the whole file, released on destruction
+  class MappedText
+  {
+  public:
+    const char *data;
+    size_t size;
+
+    MappedText() : data(0), size(0), handle(0), mapping(0) {}
+    ~MappedText() { close(); }
+
+    bool open(const std::string &path)
+    {
+#ifdef _WIN32
+      HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (file_handle == INVALID_HANDLE_VALUE)
+        return false;
+      LARGE_INTEGER file_size;
+      GetFileSizeEx(file_handle, &file_size);
+      handle = file_handle;
+      size = file_size.QuadPart;
+      mapping = size ? CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL) : 0;
+      data = mapping ? (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+#else
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat info;
+      fstat(fd, &info);
+      size = info.st_size;
+      void *address = size ? mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      data = address == MAP_FAILED ? 0 : (const char *) address;
+#endif
+      return data != 0 || size == 0;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+      if (data)
+        UnmapViewOfFile(data);
+      if (mapping)
+        CloseHandle(mapping);
+      if (handle)
+        CloseHandle(handle);
+#else
+      if (data)
+        munmap((void *) data, size);
+#endif
+      data = 0;
+      size = 0;
+      handle = 0;
+      mapping = 0;
+    }
+
+  private:
+    void *handle;
+    void *mapping;
+  };
+
+  // Offset of the face references counted from the end of a chunk
+  const long long relative = 1LL << 50;
+
+  // Vertices and faces read from a chunk. A face reference is the 0-based index in the
+  // file, or i - relative for the vertex i of the chunk (i may be negative, a vertex of
+  // the previous chunks) when the file used a negative index
+  struct ParsedChunk
+  {
+    const char *begin;
+    const char *end;
+    std::vector<float> positions;   // x, y
+    std::vector<float> colors;      // r, g, b
+    std::vector<long long> faces;   // Three references per triangle
+    unsigned int skipped;
+    unsigned int first_vertex;      // Vertices of the previous chunks
+    unsigned int first_column;      // New columns of V filled by the previous chunks
+
+    ParsedChunk() : begin(0), end(0), skipped(0), first_vertex(0), first_column(0) {}
+  };
+
+  inline bool is_digit(char c)
+  {
+    return c >= '0' && c <= '9';
+  }
+
+  inline bool is_separator(char c)
+  {
+    return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+  }
+
+  // Decimal number with an optional exponent. The 19 first significant digits are kept
+  // and scaled once, which is exact enough for floats and several times faster than strtof
+  bool parse_float(const char *&p, const char *end, float &value)
+  {
+    static const double powers[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+      negative = *s++ == '-';
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; s < end && is_digit(*s); s++, any = true)
+    {
+      if (digits < 19)
+      {
+        mantissa = 10 * mantissa + (*s - '0');
+        digits += mantissa != 0;
+      }
+      else
+        exponent++;
+    }
+    if (s < end && *s == '.')
+    {
+      for (s++; s < end && is_digit(*s); s++, any = true)
+      {
+        if (digits < 19)
+        {
+          mantissa = 10 * mantissa + (*s - '0');
+          digits += mantissa != 0;
+          exponent--;
+        }
+      }
+    }
+    if (!any)
+      return false;
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+      const char *e = s + 1;
+      bool negative_exponent = false;
+      if (e < end && (*e == '-' || *e == '+'))
+        negative_exponent = *e++ == '-';
+      if (e < end && is_digit(*e))
+      {
+        int x = 0;
+        for (; e < end && is_digit(*e); e++)
+          x = std::min(10 * x + (*e - '0'), 10000);
+        exponent += negative_exponent ? -x : x;
+        s = e;
+      }
+    }
+    double v = double(mantissa);
+    if (exponent < 0)
+      v = exponent >= -22 ? v / powers[-exponent] : v * pow(10.0, exponent);
+    else if (exponent > 0)
+      v = exponent <= 22 ? v * powers[exponent] : v * pow(10.0, exponent);
+    value = float(negative ? -v : v);
+    p = s;
+    return true;
+  }
+
+  // Values of a line, -1 if one of them is not a number
+  int parse_values(const char *p, const char *end, float *values, int capacity)
+  {
+    int n = 0;
+    while (true)
+    {
+      while (p < end && is_separator(*p))
+        p++;
+      if (p == end)
+        return n;
+      if (n == capacity || !parse_float(p, end, values[n]) || (p < end && !is_separator(*p)))
+        return -1;
+      n++;
+    }
+  }
+
+  void add_vertex(ParsedChunk &chunk, float x, float y, const float *rgb)
+  {
+    chunk.positions.push_back(x);
+    chunk.positions.push_back(y);
+    chunk.colors.insert(chunk.colors.end(), rgb, rgb + 3);
+  }
+
+  void parse_csv(ParsedChunk &chunk, const float *color)
+  {
+    float values[15];
+    for (const char *line = chunk.begin; line < chunk.end;)
+    {
+      const char *eol = (const char *) memchr(line, '\n', chunk.end - line);
+      if (!eol)
+        eol = chunk.end;
+      int n = parse_values(line, eol, values, 15);
+      if (n == 2 || n == 3)
+        add_vertex(chunk, values[0], values[1], color);
+      else if (n == 5)
+        add_vertex(chunk, values[0], values[1], values + 2);
+      else if (n == 6)
+        for (int k = 0; k < 3; k++)
+          add_vertex(chunk, values[2*k], values[2*k+1], color);
+      else if (n == 15)
+        for (int k = 0; k < 3; k++)
+          add_vertex(chunk, values[5*k], values[5*k+1], values + 5*k+2);
+      else if (n != 0)
+        chunk.skipped++;
+      line = eol + 1;
+    }
+  }
+
+  // Vertex references of a face: "i", "i/t", "i//n" or "i/t/n"
+  bool parse_references(const char *p, const char *end, std::vector<long long> &references)
+  {
+    references.clear();
+    while (true)
+    {
+      while (p < end && is_separator(*p))
+        p++;
+      if (p == end)
+        return references.size() >= 3;
+      bool negative = *p == '-';
+      if (negative || *p == '+')
+        p++;
+      if (p == end || !is_digit(*p))
+        return false;
+      long long index = 0;
+      for (; p < end && is_digit(*p); p++)
+        index = std::min(10 * index + (*p - '0'), 1LL << 40);
+      if (index == 0)
+        return false;
+      references.push_back(negative ? -index : index);
+      while (p < end && !is_separator(*p))
+        p++;
+    }
+  }
+
+  void parse_obj(ParsedChunk &chunk, const float *color)
+  {
+    float values[7];
+    std::vector<long long> references;
+    for (const char *line = chunk.begin; line < chunk.end;)
+    {
+      const char *eol = (const char *) memchr(line, '\n', chunk.end - line);
+      if (!eol)
+        eol = chunk.end;
+      const char *p = line;
+      while (p < eol && is_separator(*p))
+        p++;
+      line = eol + 1;
+      if (eol - p < 2 || (p[1] != ' ' && p[1] != '\t'))
+        continue;
+
+      if (p[0] == 'v')
+      {
+        // x y, x y z, x y z w or x y z r g b
+        int n = parse_values(p + 2, eol, values, 7);
+        if (n == 6 || n == 7)
+          add_vertex(chunk, values[0], values[1], values + 3);
+        else if (n >= 2)
+          add_vertex(chunk, values[0], values[1], color);
+        else
+          chunk.skipped++;
+      }
+      else if (p[0] == 'f')
+      {
+        if (!parse_references(p + 2, eol, references))
+        {
+          chunk.skipped++;
+          continue;
+        }
+        long long local = chunk.positions.size() / 2;
+        for (unsigned int i = 0; i < references.size(); i++)
+          references[i] = references[i] > 0 ? references[i] - 1 : local + references[i] - relative;
+        for (unsigned int i = 1; i + 1 < references.size(); i++)
+        {
+          chunk.faces.push_back(references[0]);
+          chunk.faces.push_back(references[i]);
+          chunk.faces.push_back(references[i+1]);
+        }
+      }
+    }
+  }
+
+  // Call work(i) for i in [0, count) on all the cores
+  void parallel_for(unsigned int count, const std::function<void(unsigned int)> &work)
+  {
+    std::atomic<unsigned int> next(0);
+    auto run = [&]() {
+      for (unsigned int i = next++; i < count; i = next++)
+        work(i);
+    };
+    unsigned int threads = std::max(1u, std::min(std::thread::hardware_concurrency(), count));
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; t++)
+      workers.push_back(std::thread(run));
+    run();
+    for (unsigned int t = 0; t < workers.size(); t++)
+      workers[t].join();
+  }
+
+  bool has_extension(const std::string &path, const char *extension)
+  {
+    size_t n = strlen(extension);
+    if (path.size() < n)
+      return false;
+    for (size_t i = 0; i < n; i++)
+      if (tolower(path[path.size() - n + i]) != extension[i])
+        return false;
+    return true;
+  }
+}
+
+bool importTriangles(const std::string &path, Eigen::MatrixXf &V, Eigen::MatrixXf &C, const Eigen::Vector3f &color, ImportStats *stats)
+{
+  using namespace std;
+  auto start = chrono::steady_clock::now();
+  MappedText file;
+  if (!file.open(path))
+  {
+    cerr << "Cannot open " << path << endl;
+    return false;
+  }
+
+  // Cut the file after the first line break following every chunk_bytes
+  vector<ParsedChunk> chunks;
+  const char *end = file.data + file.size;
+  for (const char *begin = file.data; begin < end;)
+  {
+    const char *cut = end - begin > (ptrdiff_t) chunk_bytes ? begin + chunk_bytes : end;
+    const char *eol = cut < end ? (const char *) memchr(cut, '\n', end - cut) : 0;
+    ParsedChunk chunk;
+    chunk.begin = begin;
+    chunk.end = eol ? eol + 1 : end;
+    chunks.push_back(chunk);
+    begin = chunk.end;
+  }
+
+  bool obj = has_extension(path, ".obj");
+  parallel_for(chunks.size(), [&](unsigned int c) {
+    if (obj)
+      parse_obj(chunks[c], color.data());
+    else
+      parse_csv(chunks[c], color.data());
+  });
+
+  unsigned int vertices = 0, skipped = 0;
+  for (unsigned int c = 0; c < chunks.size(); c++)
+  {
+    chunks[c].first_vertex = vertices;
+    vertices += chunks[c].positions.size() / 2;
+  }
+
+  // The faces refer to vertices of any chunk, the OBJ vertices are gathered first
+  vector<float> positions, colors;
+  if (obj)
+  {
+    positions.resize(2 * size_t(vertices));
+    colors.resize(3 * size_t(vertices));
+    parallel_for(chunks.size(), [&](unsigned int c) {
+      ParsedChunk &chunk = chunks[c];
+      copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + 2 * size_t(chunk.first_vertex));
+      copy(chunk.colors.begin(), chunk.colors.end(), colors.begin() + 3 * size_t(chunk.first_vertex));
+      vector<float>().swap(chunk.positions);
+      vector<float>().swap(chunk.colors);
+
+      // Resolve the references and drop the faces with a missing vertex
+      unsigned int kept = 0;
+      for (unsigned int f = 0; f + 2 < chunk.faces.size(); f += 3)
+      {
+        bool valid = true;
+        for (unsigned int k = 0; k < 3; k++)
+        {
+          long long &r = chunk.faces[f+k];
+          if (r < 0)
+            r += relative + chunk.first_vertex;
+          valid = valid && r >= 0 && r < vertices;
+        }
+        if (valid)
+        {
+          for (unsigned int k = 0; k < 3; k++)
+            chunk.faces[kept++] = chunk.faces[f+k];
+        }
+        else
+          chunk.skipped++;
+      }
+      chunk.faces.resize(kept);
+    });
+  }
+
+  // The CSV vertices are the soup, a triangle may span two chunks. The last vertices are
+  // dropped if they do not form a triangle
+  unsigned int columns = 0;
+  for (unsigned int c = 0; c < chunks.size(); c++)
+  {
+    skipped += chunks[c].skipped;
+    chunks[c].first_column = obj ? columns : chunks[c].first_vertex;
+    columns += obj ? chunks[c].faces.size() : 0;
+  }
+  if (!obj)
+  {
+    columns = vertices - vertices % 3;
+    skipped += vertices % 3;
+  }
+  unsigned int triangles = columns / 3;
+
+  // Fill the new columns of V and C directly, each chunk at its own offset
+  unsigned int first = V.cols();
+  V.conservativeResize(2, first + 3 * triangles);
+  C.conservativeResize(3, first + 3 * triangles);
+  parallel_for(chunks.size(), [&](unsigned int c) {
+    const ParsedChunk &chunk = chunks[c];
+    unsigned int column = first + chunk.first_column;
+    if (obj)
+    {
+      for (unsigned int f = 0; f < chunk.faces.size(); f++, column++)
+      {
+        size_t v = chunk.faces[f];
+        V(0, column) = positions[2*v];
+        V(1, column) = positions[2*v+1];
+        C.col(column) << colors[3*v], colors[3*v+1], colors[3*v+2];
+      }
+    }
+    else
+    {
+      size_t count = min(chunk.positions.size() / 2, size_t(columns - min(columns, chunk.first_column)));
+      if (count == 0)
+        return;
+      memcpy(V.col(column).data(), &chunk.positions[0], count * 2 * sizeof(float));
+      memcpy(C.col(column).data(), &chunk.colors[0], count * 3 * sizeof(float));
+    }
+  });
+
+  if (stats)
+  {
+    stats->bytes = file.size;
+    stats->triangles = triangles;
+    stats->skipped = skipped;
+    stats->ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  }
+  return true;
+}
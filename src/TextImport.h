@@ -0,0 +1,34 @@
+#ifndef TEXT_IMPORT_H
+#define TEXT_IMPORT_H
+
+#include <string>
+
+#include <Eigen/Core>
+
+// Counters of the last importTriangles
+struct ImportStats
+{
+  unsigned long long bytes;
+  unsigned int triangles;
+  unsigned int skipped;   // Lines and faces that could not be read
+  double ms;
+
+  ImportStats() : bytes(0), triangles(0), skipped(0), ms(0) {}
+
+  double megabytesPerSecond() const { return ms > 0 ? bytes / (1024.0 * 1024.0) / (ms / 1000) : 0; }
+};
+
+// Append the triangles of a text file to the soup V, C. The file is mapped,
+// cut into chunks at line boundaries and the chunks are parsed in parallel.
+//
+// .obj: "v x y [z] [r g b]" vertices and "f" faces, the polygons are split
+// into fans. Negative indices count back from the last vertex.
+// .csv (any other extension): one vertex per row "x,y[,z]" or "x,y,r,g,b",
+// every three vertices form a triangle, or one triangle per row with 6 or 15
+// values (three vertices of 2 or 5 values). Spaces, tabs or semicolons may
+// separate the values, the rows that are not numbers (headers) are skipped.
+//
+// The vertices without a color get color
+bool importTriangles(const std::string &path, Eigen::MatrixXf &V, Eigen::MatrixXf &C, const Eigen::Vector3f &color, ImportStats *stats = 0);
+
+#endif
@@ -0,0 +1,190 @@
+#include "Transparency.h"
+
+#include <iostream>
+
+namespace
+{
+  const char *composite_vertex_shader =
+    "#version 150 core\n"
+    "void main()"
+    "{"
+    "    gl_Position = vec4(gl_VertexID == 1 ? 3.0 : -1.0, gl_VertexID == 2 ? 3.0 : -1.0, 0.0, 1.0);"
+    "}";
+
+  const char *composite_fragment_shader =
+    "#version 150 core\n"
+    "uniform sampler2D accumulation;"
+    "uniform sampler2D weights;"
+    "out vec4 outColor;"
+    "void main()"
+    "{"
+    "    ivec2 pixel = ivec2(gl_FragCoord.xy);"
+    "    vec4 sum = texelFetch(accumulation, pixel, 0);"
+    "    float revealage = sum.a;"
+    "    if (revealage == 1.0)"
+    "        discard;"
+    "    float weight = texelFetch(weights, pixel, 0).r;"
+    "    outColor = vec4(sum.rgb / max(weight, 1e-5), 1.0 - revealage);"
+    "}";
+
+  GLuint create_target(GLint internal_format, GLenum format, int width, int height)
+  {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+  }
+
+  // Depth format of the bound draw framebuffer, 0 if it has no depth buffer
+  GLenum bound_depth_format()
+  {
+    GLint bound;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+    GLenum depth_attachment = bound ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+    GLenum stencil_attachment = bound ? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+
+    GLint type = GL_NONE;
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depth_attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+    if (type == GL_NONE)
+      return 0;
+    GLint depth_bits = 0, component = GL_UNSIGNED_NORMALIZED, stencil_bits = 0;
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depth_attachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depth_bits);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, depth_attachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &component);
+    glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, stencil_attachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+    if (type != GL_NONE)
+      glGetFramebufferAttachmentParameteriv(GL_DRAW_FRAMEBUFFER, stencil_attachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_bits);
+
+    // Blitting the depth needs the exact same format on both sides
+    if (component == GL_FLOAT)
+      return stencil_bits ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+    if (depth_bits <= 16)
+      return GL_DEPTH_COMPONENT16;
+    return stencil_bits ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+  }
+}
+
+bool WeightedBlendedOit::init()
+{
+  if (!composite_program.init(composite_vertex_shader, composite_fragment_shader, "outColor"))
+    return false;
+  composite_program.bind();
+  glUniform1i(composite_program.uniform("accumulation"), 0);
+  glUniform1i(composite_program.uniform("weights"), 1);
+  screen.init();
+  return true;
+}
+
+void WeightedBlendedOit::resize(int width, int height)
+{
+  GLenum format = bound_depth_format();
+  if (framebuffer && width == this->width && height == this->height && format == depth_format)
+    return;
+  if (framebuffer)
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &accumulation);
+    glDeleteTextures(1, &weights);
+    glDeleteRenderbuffers(1, &depth);
+    depth = 0;
+  }
+  this->width = width;
+  this->height = height;
+  depth_format = format;
+
+  // Half floats keep the sums of many layers, the weights only need one channel
+  accumulation = create_target(GL_RGBA16F, GL_RGBA, width, height);
+  weights = create_target(GL_R16F, GL_RED, width, height);
+
+  GLint previous;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulation, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weights, 0);
+  if (depth_format)
+  {
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, depth_format, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    bool stencil = depth_format == GL_DEPTH24_STENCIL8 || depth_format == GL_DEPTH32F_STENCIL8;
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+  }
+  GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, buffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "Transparency targets are not supported" << std::endl;
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+  check_gl_error();
+}
+
+void WeightedBlendedOit::begin()
+{
+  GLint previous;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+  target = previous;
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  if (depth)
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+  GLboolean mask;
+  glGetBooleanv(GL_DEPTH_WRITEMASK, &mask);
+  depth_write = mask;
+  glDepthMask(GL_FALSE);
+
+  GLfloat empty_sum[4] = {0, 0, 0, 1};
+  GLfloat empty_weight[4] = {0, 0, 0, 0};
+  glClearBufferfv(GL_COLOR, 0, empty_sum);
+  glClearBufferfv(GL_COLOR, 1, empty_weight);
+
+  glEnable(GL_BLEND);
+  glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void WeightedBlendedOit::composite()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, target);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDepthMask(depth_write);
+  GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+  glDisable(GL_DEPTH_TEST);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, accumulation);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, weights);
+  composite_program.bind();
+  screen.bind();
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glDisable(GL_BLEND);
+  if (depth_test)
+    glEnable(GL_DEPTH_TEST);
+}
+
+void WeightedBlendedOit::free()
+{
+  if (framebuffer)
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &accumulation);
+    glDeleteTextures(1, &weights);
+    if (depth)
+      glDeleteRenderbuffers(1, &depth);
+    framebuffer = 0;
+    depth = 0;
+  }
+  width = 0;
+  height = 0;
+  composite_program.free();
+  screen.free();
+}
@@ -0,0 +1,57 @@
+#ifndef TRANSPARENCY_H
+#define TRANSPARENCY_H
+
+#include "Helpers.h"
+
+// Weighted blended order-independent transparency (McGuire and Bavoil 2013).
+// Between begin() and composite() the translucent fragments are accumulated
+// in any order into two targets, with the blending set to ONE, ONE for the
+// colors and ZERO, ONE_MINUS_SRC_ALPHA for the alpha channel:
+// - outColor[0] = vec4(color * alpha * weight, alpha) sums the weighted
+//   colors and multiplies the revealage (1 - alpha) of the fragments
+// - outColor[1] = vec4(alpha * weight) sums the weights
+// composite() then blends their weighted average over the opaque image.
+// The weight should grow with the distance to the back of the scene, so
+// that the front layers dominate where many translucent fragments overlap.
+// The depth of the opaque image is copied into the targets, so translucent
+// fragments hidden by opaque geometry are rejected by the depth test.
+class WeightedBlendedOit
+{
+public:
+  typedef unsigned int GLuint;
+
+  int width;
+  int height;
+
+  WeightedBlendedOit() : width(0), height(0), framebuffer(0), accumulation(0), weights(0), depth(0), depth_format(0), target(0), depth_write(true) {}
+
+  // Compile the composite program
+  bool init();
+
+  // Allocate the targets for a viewport of width x height pixels, with a depth
+  // buffer in the format of the bound framebuffer. Nothing is done if neither changed
+  void resize(int width, int height);
+
+  // Redirect the drawing to the cleared accumulation targets, the depth is
+  // tested against the bound framebuffer but not written
+  void begin();
+
+  // Restore the previous framebuffer and blend the accumulated fragments over it
+  void composite();
+
+  // Release the targets and the program
+  void free();
+
+private:
+  GLuint framebuffer;
+  GLuint accumulation;
+  GLuint weights;
+  GLuint depth;
+  GLuint depth_format;
+  GLuint target;                 // Framebuffer bound before begin()
+  bool depth_write;
+  Program composite_program;
+  VertexArrayObject screen;      // Draws a full screen triangle from gl_VertexID
+};
+
+#endif
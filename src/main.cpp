@@ -2,6 +2,55 @@
 
 // OpenGL Helpers to reduce the clutter
 #include "Helpers.h"
+#include "Geometry.h"
+
+// View-frustum culling of the triangle soup
+#include "Culling.h"
+
+// Aggregated level of detail for zoomed out views
+#include "Lod.h"
+
+// Chunked scene files streamed to the GPU
+#include "SceneFile.h"
+
+// Triangles sharing welded vertices
+#include "IndexedMesh.h"
+
+// Order-independent transparency
+#include "Transparency.h"
+
+// Multisampled offscreen rendering
+#include "Antialiasing.h"
+
+// Window events passed from the event thread to the render thread
+#include "EventQueue.h"
+
+// Long edits of the soup applied next to the frames
+#include "EditThread.h"
+
+// Undo history of the edits
+#include "CommandLog.h"
+
+// Rectangle and lasso selection of many triangles
+#include "Selection.h"
+#include "FrameArena.h"
+#include "ShaderCache.h"
+#include "ShaderVariants.h"
+
+// Vector picture of the triangle soup
+#include "SvgExport.h"
+
+// Triangles read from OBJ and CSV files
+#include "TextImport.h"
+
+// Images larger than the framebuffers, drawn tile by tile
+#include "Poster.h"
+
+// Triangle picking from a buffer of object IDs
+#include "Picking.h"
+
+// Golden images and frame times of canonical scenes
+#include "Regression.h"
 
 // GLFW is necessary to handle the OpenGL context
 #include <GLFW/glfw3.h>
@@ -13,28 +62,285 @@
 // Timer
 #include <chrono>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <new>
 #include <string>
+#include <thread>
+#include <vector>
 using namespace std;
 
-#define PI 3.14159265
+// VertexArrayObject wrapper
+VertexArrayObject VAO;
 
 // VertexBufferObject wrapper
 VertexBufferObject VBO;
 
+// Program drawing all the geometry, the plain variant of shaders
+Program program;
+
+// Variants of the triangle shader with the outlines, the analytic antialiasing or the
+// transparency accumulation compiled in, built in parallel while the plain program draws
+ShaderVariants shaders;
+const char *shaderVariantModeNames[3] = {"built on first use", "built by the driver threads", "built on a background context"};
+
 // VertexBufferObject wrapper
 VertexBufferObject VBO_C;
 
+// Opacity of the vertices, kept in its own buffer in both layouts
+VertexBufferObject VBO_A;
+
+// Layer of the vertices, kept in its own buffer so that restacking is a single write
+VertexBufferObject VBO_L;
+
+// Interleaved layout: positions and colors share VBO_VC as x,y,r,g,b columns
+bool interleavedLayout = false;
+VertexBufferObject VBO_VC;
+Eigen::MatrixXf VC;
+
+// Bumped by every upload of V or C, lets the CPU side caches detect stale data
+unsigned long positionRevision = 0;
+unsigned long colorRevision = 0;
+unsigned long uploadedBytes = 0;
+
+// GPU time of the frames measured with timer queries, to compare the layouts. The queries
+// of the last frames are in a ring and read once available, so the CPU never waits for them
+const unsigned int drawTimeQueries = 3;
+GLuint drawTimeQuery[drawTimeQueries] = {0, 0, 0};
+bool drawTimePending[drawTimeQueries] = {false, false, false};
+int drawTimeMode[drawTimeQueries] = {0, 0, 0};
+unsigned int drawTimeNext = 0;     // Query of the next frame, also the oldest one pending
+bool drawTimeActive = false;
+double gpuDrawMs = 0;
+unsigned int gpuDrawFrames = 0;
+
+// Antialiasing of the frames, cycled with 'q': multisampled offscreen targets resolved into
+// the window, or analytic coverage of the triangle edges on a single sampled offscreen target.
+// The GPU time is also kept per mode
+enum Antialiasing { NO_ANTIALIASING, MSAA_2X, MSAA_4X, MSAA_8X, ANALYTIC };
+int antialiasing = Antialiasing::MSAA_8X;
+const char *antialiasingNames[5] = {"none", "2x MSAA", "4x MSAA", "8x MSAA", "analytic edges"};
+const int antialiasingSamples[5] = {0, 2, 4, 8, 0};
+MultisampleTarget msaa;
+double antialiasingGpuMs[5] = {0, 0, 0, 0, 0};
+unsigned int antialiasingFrames[5] = {0, 0, 0, 0, 0};
+
+// Frames are only drawn when something changed: the callbacks and the animation mark what
+// changed, and small changes are redrawn inside a scissor rectangle. The frame is kept in
+// the offscreen target, so the pixels outside the rectangle are those of the last frame
+DirtyRegion dirty;
+BoundingBox drawBox;
+unsigned long fullRedraws = 0;
+unsigned long partialRedraws = 0;
+double partialRedrawArea = 0;
+
+// The main thread only processes the window events and queues them, the render thread owns
+// the GL context and the scene: it applies the queued events, then draws. A slow edit or
+// frame delays the next frame but never the event processing. The sizes below are those
+// of the window when the events being applied were queued
+EventQueue events;
+int windowWidth = 0;
+int windowHeight = 0;
+int framebufferWidth = 0;
+int framebufferHeight = 0;
+
+// Events that found the queue full, kept in order by the main thread and queued once the render
+// thread made room. The render thread then wakes the main thread up with an empty event
+std::deque<InputEvent> overflowEvents;
+
+// The files written from a copy of the scene (scene.rscn, scene.svg) are written one at a time on
+// this thread, the events and frames go on meanwhile
+std::thread exportThread;
+std::atomic<bool> exporting(false);
+
+// Time from the oldest event applied by a frame to the swap of the frame
+double inputLatencyMs = 0;
+double maxInputLatencyMs = 0;
+unsigned int inputLatencyFrames = 0;
+
+// The cursor moves are coalesced: applyEvents only keeps the last position, which the scene
+// follows once per frame before the draw, or before the next button or key event. The lasso
+// keeps every point. The events and the uploads they cause are counted to compare their rates
+bool cursorPending = false;
+double pendingCursor[2] = {0, 0};
+unsigned long cursorEvents = 0;
+unsigned long cursorUploads = 0;
+std::chrono::steady_clock::time_point cursorCountStart = std::chrono::steady_clock::now();
+
+// Linked programs are cached on disk, --shader-cache <dir> moves the cache and "none" disables it.
+// The time from the start of main to the first frame is reported to compare cold and warm starts
+ProgramCache programCache;
+string shaderCacheDirectory = "shader_cache";
+std::chrono::steady_clock::time_point launchTime;
+
+// --regress <dir> replays the canonical scenes in a hidden window and compares their last frame
+// with the golden images of dir (regression/ in the repository), a missing image fails unless
+// --record is given to write them. --frame-times <json> writes the frame times of the scenes,
+// --baseline <json> fails the scenes whose median frame time grew by more than --slowdown (a
+// fraction) compared with the baseline. Without a display the regression exits with
+// regressionSkipped, which ctest reports as skipped
+string regressionDirectory;
+const int regressionSkipped = 77;
+bool recordGoldens = false;
+string frameTimesPath;
+string baselinePath;
+double slowdownThreshold = 0.10;
+int pixelTolerance = 2;               // Largest difference of a channel still matching, --tolerance
+const double differingFraction = 0.001;
+const unsigned int timedFrames = 30;
+
+// Temporaries of the frame are taken from the arena, released after the swap. The heap
+// allocations made between two swaps are counted to keep the steady state at zero: the
+// operator new of this program counts those of the standard containers and strings. The
+// dynamic Eigen matrices go through malloc, debug builds define EIGEN_RUNTIME_NO_MALLOC so
+// that Eigen asserts if one is allocated while drawing a frame
+FrameArena frameArena;
+std::atomic<unsigned long> heapAllocationCount(0);
+unsigned long heapAllocationsAtSwap = 0;
+unsigned long heapFrameAllocations = 0;
+unsigned long maxHeapFrameAllocations = 0;
+unsigned int heapFrames = 0;
+
+void *countedMalloc(size_t bytes){
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(bytes ? bytes : 1);
+}
+
+void *operator new(size_t bytes){
+    void *p = countedMalloc(bytes);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t bytes){
+    return operator new(bytes);
+}
+
+void *operator new(size_t bytes, const std::nothrow_t&) noexcept{
+    return countedMalloc(bytes);
+}
+
+void *operator new[](size_t bytes, const std::nothrow_t&) noexcept{
+    return countedMalloc(bytes);
+}
+
+void operator delete(void *p) noexcept{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept{
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept{
+    std::free(p);
+}
+
+// Number of operator new calls of the process so far, on any thread
+unsigned long heapAllocations(){
+    return heapAllocationCount.load(std::memory_order_relaxed);
+}
+
+// Whether Eigen may allocate, only checked in debug builds
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+void allowEigenMalloc(bool allowed){
+    Eigen::internal::set_is_malloc_allowed(allowed);
+}
+#else
+void allowEigenMalloc(bool){
+}
+#endif
+
+// ElementBufferObject holding the compacted indices of the visible triangles
+ElementBufferObject EBO;
+
+// Vertex array and buffers holding the aggregated cells drawn for zoomed out views
+VertexArrayObject VAO_LOD;
+VertexBufferObject VBO_LOD;
+VertexBufferObject VBO_LOD_C;
+
 // Contains the vertex positions
 Eigen::MatrixXf V;
 
 // Contains the color value for respective vertices
 Eigen::MatrixXf C;
 
+// Contains the opacity of respective vertices, edited one object at a time
+Eigen::MatrixXf A;
+
+// Contains the layer of respective vertices, the same for the three vertices of a triangle.
+// Higher layers are in front, the vertex shaders map a layer l to the depth 1 - l/2^23, which
+// keeps the 2^24 layers apart in a 24-bit depth buffer. Buffers without layers are at layer 0
+Eigen::MatrixXf L;
+float topLayer = 0;
+const float maxLayer = 16777215;
+vector<unsigned int> sortedTriangles;
+
+// Bumped by every upload of L. The opaque and translucent lists of the last frame are kept
+// with their order, a frame showing the same triangles at the same layers reuses it
+unsigned long layerRevision = 0;
+struct LayerOrder {
+    vector<unsigned int> triangles;
+    vector<unsigned int> sorted;
+    unsigned long revision;
+    bool frontToBack;
+    LayerOrder() : revision(~0UL), frontToBack(false) {}
+};
+LayerOrder opaqueOrder;
+LayerOrder translucentOrder;
+
+// Edits of at least backgroundEditColumns columns (moving a large selection, deleting, restacking)
+// run on the edit thread over back copies of V, C, A and L, while the render thread goes on drawing
+// the front copies: nothing writes them meanwhile, the events wait in the queue and the animation
+// pauses. Once the edit is done the copies are swapped and editFinish uploads the columns it
+// changed. The columns uploaded since the last swap are those the back copies miss, backStale
+// keeps their ranges, or backStaleAll once they are too many or the sizes changed
+EditThread editThread;
+Eigen::MatrixXf backV, backC, backA, backL;
+vector<pair<unsigned int, unsigned int> > backStale;
+bool backStaleAll = true;
+const unsigned int maxBackStale = 64;
+std::function<void()> editFinish;
+const unsigned int backgroundEditColumns = 3*16384;
+typedef std::function<void(Eigen::MatrixXf &V, Eigen::MatrixXf &C, Eigen::MatrixXf &A, Eigen::MatrixXf &L)> SoupEdit;
+
+// Event popped before a cursor move started an edit, applied once the edit is done
+InputEvent heldEvent;
+bool eventHeld = false;
+
 // Contains the view transformation
 Eigen::Matrix4f view(4,4);
 Eigen::Matrix4f translateView(4,4);
 Eigen::Matrix4f totalView(4,4);
+
+// Part of the view drawn by the current tile of a poster, identity otherwise. 'r' writes the
+// scene as seen in the window to poster.ppm, --poster <width> pixels wide
+Eigen::Matrix4f tileView = Eigen::Matrix4f::Identity();
+int posterWidth = 16384;
+const int posterTileSide = 1024;
+
+// With '/' the translation picks the triangle in an integer target of triangle IDs drawn with
+// the depth of the frame, instead of testing the triangles on the CPU. The target is drawn again
+// after the frames that changed the scene, the pixel under the pointer is read back as it moves
+// so that a click usually finds its triangle without waiting for the GPU
+ObjectIdBuffer pickIds;
+bool pickingSupported = false;
+bool idPicking = false;
+int hoverPixel[2] = {-1, -1};
+int hoverTriangle = -1;
+bool hoverValid = false;
+unsigned long idPasses = 0;
+unsigned long pickWaits = 0;
 Eigen::MatrixXf colorCode(3,12);
 
 enum ObjectType
@@ -75,177 +381,1447 @@ int selectedVertex = -1;
 bool setTotalView = false;
 int animatedVertex = -1;
 auto t_start = std::chrono::high_resolution_clock::now();
-Eigen::MatrixXf previousFrame(2,3);
-Eigen::MatrixXf currentFrame(2,3);
+Eigen::Matrix<float,2,3> previousFrame;
+Eigen::Matrix<float,2,3> currentFrame;
 float interpolateInterval = 0.0;
 string animationtype;
 
-bool ptInTriangle(float px, float py, float v0x, float v0y, float v1x, float v1y, float v2x, float v2y) {
-    float dX = px-v2x;
-    float dY = py-v2y;
-    float dX21 = v2x-v1x;
-    float dY12 = v1y-v2y;
-    float D = dY12*(v0x-v2x) + dX21*(v0y-v2y);
-    float s = dY12*dX + dX21*dY;
-    float t = (v2y-v0y)*dX + (v0x-v2x)*dY;
-    if (D<0) return s<=0 && t<=0 && s+t>=D;
-    return s>=0 && t>=0 && s+t<=D;
+// Spatial index over the triangle bounds used to cull off-screen triangles
+TriangleGrid grid;
+CullStats cullStats;
+vector<unsigned int> visibleTriangles;
+vector<unsigned int> drawIndices;
+
+// Triangles smaller than a cell of lodCellPixels on screen are drawn through the aggregated cells
+LodPyramid lod;
+float lodCellPixels = 4.0;
+int lodLevel = -1;
+unsigned int lodCells = 0;
+Eigen::Vector3f backgroundColor(0.5, 0.5, 0.5);
+
+// Scene file streamed chunk by chunk under a GPU memory budget, drawn below the edited triangles
+MappedSceneFile sceneFile;
+ChunkCache chunkCache;
+unsigned long frameNumber = 0;
+
+// Indexed mode: the triangles share a pool of welded vertices drawn through one index buffer,
+// the soup V only holds the triangle being inserted
+bool indexedMode = false;
+IndexedMesh mesh;
+float weldRadius = 0.01;
+int selectedMeshVertex = -1;
+VertexArrayObject VAO_MESH;
+VertexBufferObject VBO_MESH;
+VertexBufferObject VBO_MESH_C;
+ElementBufferObject EBO_MESH;
+vector<unsigned int> meshIndices;
+
+// Outlines drawn as a separate GL_LINES pass or shaded by a variant of the fill shader, cycled with 'u'
+enum OutlineMode { LINE_PASS, SINGLE_PASS_SMOOTH, SINGLE_PASS };
+int outlineMode = OutlineMode::LINE_PASS;
+float outlineWidth = 1.0;
+const char *outlineModeNames[3] = {"separate GL_LINES pass", "single pass, antialiased", "single pass, aliased"};
+
+// Translucent triangles of the soup are blended in painting order with a sorted over operator
+// (exact, the reference) or accumulated in a single unordered pass, cycled with 't'.
+// The indexed mesh and the streamed chunks stay opaque
+enum TransparencyMode { OPAQUE, WEIGHTED_BLENDED, SORTED };
+int transparencyMode = TransparencyMode::OPAQUE;
+const char *transparencyModeNames[3] = {"off, alpha is ignored", "weighted blended order-independent transparency", "sorted blending (reference)"};
+WeightedBlendedOit oit;
+bool oitSupported = false;
+unsigned int translucentTriangles = 0;
+
+// Edits of the soup recorded for undo (ctrl+z) and redo (ctrl+y or ctrl+shift+z). A triangle
+// record holds its positions, colors, opacities and layer
+CommandLog history;
+const unsigned int triangleRecordSize = 19;
+
+// Multi-selection in translation mode: shift+drag selects the triangles whose centroid is in
+// a rectangle, ctrl+drag those in a lasso. Dragging a selected triangle moves the selection,
+// 'h'/'j'/'k'/'l' rotate and scale it around its centroid
+Selection selection;
+bool selecting = false;
+bool lassoSelection = false;
+bool draggingSelection = false;
+Eigen::Vector2f selectionStart;
+Eigen::MatrixXf selectionBand;
+Eigen::Matrix4f dragTransform;
+vector<TriangleRun> selectionRuns;
+
+// Rebuilding the grid and the LOD pyramid at every step of a drag costs O(n) per frame, so
+// they keep the positions from before the drag until it ends. The moved triangles are culled
+// through gridDrag, their translation since the grid was built
+bool gridDeferred = false;
+unsigned long gridDeferredRevision = 0;   // positionRevision after the last deferred step
+Eigen::Vector2f gridDrag(0, 0);
+VertexArrayObject VAO_BAND;
+VertexBufferObject VBO_BAND;
+
+// Storage format of the soup and mesh buffers, cycled with 'f'
+int vertexFormat = 0;
+const char *vertexFormatNames[3] = {"32-bit float positions and colors", "half-float positions, RGBA8 colors", "16-bit normalized positions, RGBA8 colors"};
+
+void interleave(unsigned int first, unsigned int count){
+    VC.resize(5, count);
+    VC.topRows(2) = V.middleCols(first, count);
+    VC.bottomRows(3) = C.middleCols(first, count);
 }
 
-void removeColumn(Eigen::MatrixXf& matrix, unsigned int colToRemove)
-{
-    unsigned int numRows = matrix.rows();
-    unsigned int numCols = matrix.cols()-1;
-    
-    if( colToRemove < numCols )
-        matrix.block(0,colToRemove,numRows,numCols-colToRemove) = matrix.rightCols(numCols-colToRemove);
-    
-    matrix.conservativeResize(numRows,numCols);
+// Remember that the back copies miss count columns starting at first
+void markBackStale(unsigned int first, unsigned int count){
+    if(backStaleAll)
+        return;
+    if(V.cols() != backV.cols() || C.cols() != backC.cols() || A.cols() != backA.cols() || L.cols() != backL.cols() || backStale.size() == maxBackStale){
+        backStaleAll = true;
+        backStale.clear();
+    } else if(count > 0 && (backStale.empty() || backStale.back() != make_pair(first, count))){
+        backStale.push_back(make_pair(first, count));
+    }
 }
 
+// Copy count columns starting at first, those past the end of from are left out
+void copyColumns(Eigen::MatrixXf &to, const Eigen::MatrixXf &from, unsigned int first, unsigned int count){
+    if(first < from.cols())
+        to.middleCols(first, min<unsigned int>(count, from.cols() - first)) = from.middleCols(first, min<unsigned int>(count, from.cols() - first));
+}
 
-Eigen::Matrix4f rotate(double degree){
-    // Contains the rotation transformation
-    Eigen::Matrix4f rotation(4,4);
-    
-    rotation <<
-    cos(degree*PI/180), -sin(degree*PI/180), 0, 0,
-    sin(degree*PI/180), cos(degree*PI/180), 0, 0,
-    0, 0, 1, 0,
-    0, 0, 0, 1;
-    
-    return rotation;
+// Bring the back copies up to date with the front ones, on the edit thread
+void syncBackCopies(const vector<pair<unsigned int, unsigned int> > &stale, bool all){
+    if(all || V.cols() != backV.cols() || C.cols() != backC.cols() || A.cols() != backA.cols() || L.cols() != backL.cols()){
+        backV = V;
+        backC = C;
+        backA = A;
+        backL = L;
+        return;
+    }
+    for(unsigned int i = 0; i < stale.size(); i++){
+        copyColumns(backV, V, stale[i].first, stale[i].second);
+        copyColumns(backC, C, stale[i].first, stale[i].second);
+        copyColumns(backA, A, stale[i].first, stale[i].second);
+        copyColumns(backL, L, stale[i].first, stale[i].second);
+    }
 }
 
-Eigen::Matrix4f translate(float x, float y){
-    // Contains the translation transformation
-    Eigen::Matrix4f translate(4,4);
-    
-    translate <<
-    1, 0, 0, x,
-    0, 1, 0, y,
-    0, 0, 1, 0,
-    0, 0, 0, 1;
-    
-    return translate;
+// Swap in the back copies once the edit thread is done and finish the edit on this thread.
+// False while the edit runs or when none was started, wait blocks until the edit is done
+bool publishEdit(bool wait){
+    if(wait)
+        editThread.wait(-1);
+    if(!editThread.finished())
+        return false;
+    V.swap(backV);
+    C.swap(backC);
+    A.swap(backA);
+    L.swap(backL);
+    std::function<void()> finish;
+    finish.swap(editFinish);
+    finish();
+    return true;
 }
 
-Eigen::Matrix4f scale(float zoom){
-    // Contains the rotation transformation
-    Eigen::Matrix4f scale(4,4);
-    
-    scale <<
-    zoom, 0, 0, 0,
-    0, zoom, 0, 0,
-    0, 0, 1, 0,
-    0, 0, 0, 1;
-    
-    return scale;
+// Apply edit to columns columns of V, C, A and L, then finish, which uploads them. Large edits
+// run on the edit thread over the back copies and finish runs once they are swapped in
+void applySoupEdit(unsigned int columns, const SoupEdit &edit, const std::function<void()> &finish){
+    publishEdit(true);
+    if(columns < backgroundEditColumns){
+        edit(V, C, A, L);
+        finish();
+        return;
+    }
+    vector<pair<unsigned int, unsigned int> > stale(backStale);
+    bool all = backStaleAll;
+    backStale.clear();
+    backStaleAll = false;
+    editFinish = finish;
+    editThread.start([stale, all, edit](){
+        syncBackCopies(stale, all);
+        edit(backV, backC, backA, backL);
+    });
+}
+
+// Upload count vertices of V and C starting at first as one contiguous range per buffer,
+// or the whole scene when its size changed
+void uploadVertices(unsigned int first, unsigned int count, bool positions = true){
+    markBackStale(first, count);
+    // Triangles appended to the soup are opaque and stacked on top of the others
+    if(A.cols() != V.cols()){
+        unsigned int previous = A.cols();
+        A.conservativeResize(1, V.cols());
+        L.conservativeResize(1, V.cols());
+        for(unsigned int i = previous; i < A.cols(); i++){
+            A(0, i) = 1;
+            L(0, i) = i % 3 == 0 ? ++topLayer : L(0, i-1);
+        }
+    }
+    if(VBO_A.cols != A.cols() || (count > 0 && !VBO_A.updateColumns(A.col(first).data(), first, count))){
+        VBO_A.update(A);
+        VBO_L.update(L);
+        layerRevision++;
+        uploadedBytes += A.cols()*(VBO_A.bytesPerColumn() + VBO_L.bytesPerColumn());
+    } else {
+        uploadedBytes += count*VBO_A.bytesPerColumn();
+    }
+    if(interleavedLayout){
+        if(VBO_VC.cols != V.cols()){
+            interleave(0, V.cols());
+            VBO_VC.update(VC);
+            uploadedBytes += VC.size()*sizeof(float);
+        } else if(count > 0){
+            interleave(first, count);
+            VBO_VC.updateColumns(VC.data(), first, count);
+            uploadedBytes += VC.size()*sizeof(float);
+        }
+    } else {
+        if(positions){
+            if(VBO.cols != V.cols() || (count > 0 && !VBO.updateColumns(V.col(first).data(), first, count))){
+                VBO.update(V);
+                uploadedBytes += V.cols()*VBO.bytesPerColumn();
+            } else {
+                uploadedBytes += count*VBO.bytesPerColumn();
+            }
+        }
+        if(VBO_C.cols != C.cols() || (count > 0 && !VBO_C.updateColumns(C.col(first).data(), first, count))){
+            VBO_C.update(C);
+            uploadedBytes += C.cols()*VBO_C.bytesPerColumn();
+        } else {
+            uploadedBytes += count*VBO_C.bytesPerColumn();
+        }
+    }
+    if(positions)
+        positionRevision++;
+    colorRevision++;
+}
+
+// Upload the colors of count vertices starting at first
+void uploadColors(unsigned int first, unsigned int count){
+    uploadVertices(first, count, false);
+}
+
+// Box of count columns of M starting at first, moved by transform
+BoundingBox columnsBox(const Eigen::MatrixXf &M, int first, int count, const Eigen::Matrix4f &transform = Eigen::Matrix4f::Identity()){
+    BoundingBox box;
+    for(int i = max(first, 0); i < min(first+count, (int)M.cols()); i++){
+        Eigen::Vector4f p = transform * Eigen::Vector4f(M(0, i), M(1, i), 0, 1);
+        box.extend(p.x(), p.y());
+    }
+    return box;
+}
+
+// Apply an affine transform of the plane to the triangle starting at column first
+void transformTriangle(unsigned int first, const Eigen::Matrix4f &transform){
+    for(unsigned int i = 0; i < 3; i++){
+        Eigen::Vector4f p = transform * Eigen::Vector4f(V(0, first+i), V(1, first+i), 0, 1);
+        V.col(first+i) << p.x(), p.y();
+    }
+    uploadVertices(first, 3);
+}
+
+// Only the six coefficients of the affine transforms are recorded
+void packAffine(const Eigen::Matrix4f &transform, float *affine){
+    Eigen::Map<Eigen::Matrix2f> linear(affine);
+    Eigen::Map<Eigen::Vector2f> translation(affine+4);
+    linear = transform.block<2, 2>(0, 0);
+    translation = transform.block<2, 1>(0, 3);
 }
 
-void centroid_of_triangle(float v0x, float v0y, float v1x, float v1y, float v2x, float v2y, float &px, float &py){
-    px = (v0x + v1x + v2x) / 3;
-    py = (v0y + v1y + v2y) / 3;
+Eigen::Matrix4f unpackAffine(const float *affine){
+    Eigen::Matrix4f transform = Eigen::Matrix4f::Identity();
+    transform.block<2, 2>(0, 0) = Eigen::Map<const Eigen::Matrix2f>(affine);
+    transform.block<2, 1>(0, 3) = Eigen::Map<const Eigen::Vector2f>(affine+4);
+    return transform;
 }
 
 void updateChangesToSelectedObj(){
     if(selectedObjectIndex > -1){
-        for(unsigned int i = 0; i < 3; i++){
-            Eigen::Vector4f selectedObj;
-            selectedObj << V.col(selectedObjectIndex+i).x(), V.col(selectedObjectIndex+i).y(), 0.0, 1.0;
-            selectedObj = translateView * selectedObj;
-            V.col(selectedObjectIndex+i) << selectedObj.x(), selectedObj.y();
+        transformTriangle(selectedObjectIndex, translateView);
+        if(!translateView.isIdentity()){
+            float affine[6];
+            packAffine(translateView, affine);
+            history.push(CommandLog::TRANSFORM_TRIANGLE, selectedObjectIndex, affine, 6);
         }
-        VBO.update(V);
+
+        // The transform is now part of V
+        translateView = translate(0, 0);
     }
     if(selectedVertex > -1){
         selectedVertex = -1;
     }
 }
 
-void updateObjectColor(Eigen::MatrixXf &C, unsigned int startIndex, Eigen::Vector3f color){
-    for(unsigned int i=0; i < 3; i++){
-        C.col(startIndex+i) << color;
-    }
-    VBO_C.update(C);
+void updateObjectColor(Eigen::MatrixXf &C, unsigned int startIndex, Eigen::Vector3f color){
+    for(unsigned int i=0; i < 3; i++){
+        C.col(startIndex+i) << color;
+    }
+    uploadColors(startIndex, 3);
+}
+
+// Change the color of a vertex of the soup
+void recolorVertex(unsigned int v, const Eigen::Vector3f &color){
+    float colors[6] = {C(0, v), C(1, v), C(2, v), color.x(), color.y(), color.z()};
+    history.push(CommandLog::RECOLOR_VERTEX, v, colors, 6);
+    C.col(v) = color;
+    uploadColors(v, 1);
+}
+
+void saveTriangle(unsigned int first, float *record){
+    Eigen::Map<Eigen::MatrixXf>(record, 2, 3) = V.middleCols(first, 3);
+    Eigen::Map<Eigen::MatrixXf>(record+6, 3, 3) = C.middleCols(first, 3);
+    Eigen::Map<Eigen::MatrixXf>(record+15, 1, 3) = A.middleCols(first, 3);
+    record[18] = L(0, first);
+}
+
+// Insert count columns at column at, shifting the following ones to the right
+void insertColumns(Eigen::MatrixXf &matrix, unsigned int at, const Eigen::MatrixXf &columns){
+    unsigned int moved = matrix.cols() - at;
+    matrix.conservativeResize(Eigen::NoChange, matrix.cols() + columns.cols());
+    if(moved > 0)
+        matrix.rightCols(moved) = matrix.middleCols(at, moved).eval();
+    matrix.middleCols(at, columns.cols()) = columns;
+}
+
+// Put back a recorded triangle at column first
+void restoreTriangle(unsigned int first, const float *record){
+    vector<float> values(record, record+triangleRecordSize);
+    applySoupEdit(V.cols(), [first, values](Eigen::MatrixXf &V, Eigen::MatrixXf &C, Eigen::MatrixXf &A, Eigen::MatrixXf &L){
+        insertColumns(V, first, Eigen::Map<const Eigen::MatrixXf>(&values[0], 2, 3));
+        insertColumns(C, first, Eigen::Map<const Eigen::MatrixXf>(&values[6], 3, 3));
+        insertColumns(A, first, Eigen::Map<const Eigen::MatrixXf>(&values[15], 1, 3));
+        insertColumns(L, first, Eigen::MatrixXf::Constant(1, 3, values[18]));
+    }, [values](){
+        topLayer = max(topLayer, values[18]);
+        selection.clear();
+        uploadVertices(0, V.cols());
+    });
+}
+
+void removeTriangle(unsigned int first){
+    applySoupEdit(V.cols(), [first](Eigen::MatrixXf &V, Eigen::MatrixXf &C, Eigen::MatrixXf &A, Eigen::MatrixXf &L){
+        //note that for each removal matrix values shifts to the left and rearranges it's size
+        for(unsigned int i = 0; i < 3; i++){
+            removeColumn(V, first);
+            removeColumn(C, first);
+            removeColumn(A, first);
+            removeColumn(L, first);
+        }
+    }, [](){
+        selection.clear();
+        uploadVertices(0, V.cols());
+    });
+}
+
+// Delete the triangles containing the point, keeping them in the history. They are removed in
+// one pass, with the indices and the skips of removing them one by one: the triangle following a
+// deleted one takes its place and is not tested
+void deleteTrianglesAt(float x, float y){
+    vector<unsigned int> deleted;
+    unsigned int triangles = V.cols()/3;
+    for(unsigned int t = 0; t < triangles; t++){
+        unsigned int triangleBlock = 3*t;
+        if(ptInTriangle(x, y, V.col(triangleBlock).x(), V.col(triangleBlock).y(), V.col(triangleBlock+1).x(), V.col(triangleBlock+1).y(), V.col(triangleBlock+2).x(), V.col(triangleBlock+2).y())){
+            float record[triangleRecordSize];
+            saveTriangle(triangleBlock, record);
+            history.push(CommandLog::DELETE_TRIANGLE, triangleBlock - 3*deleted.size(), record, triangleRecordSize);
+            deleted.push_back(t++);
+        }
+    }
+    if(deleted.empty())
+        return;
+    applySoupEdit(V.cols(), [deleted](Eigen::MatrixXf &V, Eigen::MatrixXf &C, Eigen::MatrixXf &A, Eigen::MatrixXf &L){
+        removeTriangles(V, deleted);
+        removeTriangles(C, deleted);
+        removeTriangles(A, deleted);
+        removeTriangles(L, deleted);
+    }, [](){
+        selection.clear();
+        uploadVertices(0, V.cols());
+    });
+}
+
+// Bring the grid up to date with the positions in V, unless only the steps of a drag moved them
+void updateGrid(){
+    if(gridDeferred && positionRevision == gridDeferredRevision)
+        return;
+    gridDeferred = false;
+    gridDrag.setZero();
+    if(grid.revision != positionRevision){
+        grid.build(V);
+        grid.revision = positionRevision;
+    }
+}
+
+// Upload the positions of runs of triangles. Runs a few triangles apart are uploaded as one
+// range, and a very scattered selection as the single span covering it
+void uploadRuns(const vector<TriangleRun> &runs){
+    const unsigned int maxGap = 64;
+    const unsigned int maxRanges = 32;
+    vector<TriangleRun, ArenaAllocator<TriangleRun> > ranges((ArenaAllocator<TriangleRun>(frameArena)));
+    for(unsigned int r = 0; r < runs.size(); r++){
+        if(!ranges.empty() && runs[r].first - (ranges.back().first + ranges.back().second) <= maxGap)
+            ranges.back().second = runs[r].first + runs[r].second - ranges.back().first;
+        else
+            ranges.push_back(runs[r]);
+    }
+    if(ranges.size() > maxRanges)
+        ranges.assign(1, TriangleRun(ranges.front().first, ranges.back().first + ranges.back().second - ranges.front().first));
+    for(unsigned int r = 0; r < ranges.size(); r++)
+        uploadVertices(3*ranges[r].first, 3*ranges[r].second);
+}
+
+// Apply transform to runs of triangles, then run moved once the positions are uploaded. The
+// small edits are applied in place without copying the runs
+void transformTriangles(const vector<TriangleRun> &runs, const Eigen::Matrix4f &transform, const std::function<void()> &moved = std::function<void()>()){
+    unsigned int triangles = 0;
+    for(unsigned int r = 0; r < runs.size(); r++)
+        triangles += runs[r].second;
+    if(3*triangles < backgroundEditColumns){
+        publishEdit(true);
+        transformRuns(V, runs, transform);
+        uploadRuns(runs);
+        dirty.invalidate();
+        if(moved)
+            moved();
+        return;
+    }
+    applySoupEdit(3*triangles, [runs, transform](Eigen::MatrixXf &V, Eigen::MatrixXf &, Eigen::MatrixXf &, Eigen::MatrixXf &){
+        transformRuns(V, runs, transform);
+    }, [runs, moved](){
+        uploadRuns(runs);
+        dirty.invalidate();
+        if(moved)
+            moved();
+    });
+}
+
+// The runs of the selection follow the transform in its history entry
+void recordSelectionTransform(const vector<TriangleRun> &runs, const Eigen::Matrix4f &transform){
+    unsigned int count = 6 + 2*runs.size();
+    uint32_t *data = frameArena.allocate<uint32_t>(count);
+    float affine[6];
+    packAffine(transform, affine);
+    for(unsigned int i = 0; i < 6; i++)
+        data[i] = CommandLog::fromFloat(affine[i]);
+    for(unsigned int r = 0; r < runs.size(); r++){
+        data[6+2*r] = runs[r].first;
+        data[7+2*r] = runs[r].second;
+    }
+    history.push(CommandLog::TRANSFORM_TRIANGLES, runs.size(), data, count);
+}
+
+// Rotate or scale the selection around its centroid
+void transformSelection(const Eigen::Matrix4f &transform){
+    Eigen::Vector2f c = selection.centroid(V);
+    Eigen::Matrix4f aroundCentroid = translate(c.x(), c.y()) * transform * translate(-c.x(), -c.y());
+    selection.runs(selectionRuns);
+    transformTriangles(selectionRuns, aroundCentroid);
+    recordSelectionTransform(selectionRuns, aroundCentroid);
+}
+
+// Start a rectangle or lasso selection, or a drag of the selection, on a left button press.
+// Returns false when the press is left to the single selection
+bool startSelectionTool(int mods, float x, float y){
+    if(mods & (GLFW_MOD_SHIFT | GLFW_MOD_CONTROL)){
+        updateChangesToSelectedObj();
+        selectedObjectIndex = -1;
+        no_of_clicks_translate = 0;
+        selection.clear();
+        selecting = true;
+        lassoSelection = mods & GLFW_MOD_CONTROL;
+        selectionStart << x, y;
+        selectionBand = selectionStart;
+        enableCursorTrack = true;
+        return true;
+    }
+    for(unsigned int t = 0; !selection.empty() && t < V.cols()/3; t++){
+        if(selection.contains(t) && ptInTriangle(x, y, V(0, 3*t), V(1, 3*t), V(0, 3*t+1), V(1, 3*t+1), V(0, 3*t+2), V(1, 3*t+2))){
+            draggingSelection = true;
+            dragTransform = translate(0, 0);
+            pointer_x = x;
+            pointer_y = y;
+            enableCursorTrack = true;
+            return true;
+        }
+    }
+    selection.clear();
+    return false;
+}
+
+// Follow the pointer with the rectangle, the lasso or the dragged selection
+void moveSelectionTool(float x, float y){
+    if(selecting){
+        dirty.invalidate(columnsBox(selectionBand, 0, selectionBand.cols()));
+        if(lassoSelection){
+            selectionBand.conservativeResize(Eigen::NoChange, selectionBand.cols()+1);
+            selectionBand.col(selectionBand.cols()-1) << x, y;
+        } else {
+            selectionBand.resize(2, 4);
+            selectionBand << selectionStart.x(), x, x, selectionStart.x(),
+                             selectionStart.y(), selectionStart.y(), y, y;
+        }
+        dirty.invalidate(columnsBox(selectionBand, 0, selectionBand.cols()));
+    } else if(draggingSelection){
+        Eigen::Matrix4f step = translate(x - pointer_x, y - pointer_y);
+        float dx = x - pointer_x, dy = y - pointer_y;
+        updateGrid();
+        selection.runs(selectionRuns);
+        // The culling follows the triangles once their move is uploaded
+        transformTriangles(selectionRuns, step, [dx, dy](){
+            cursorUploads++;
+            gridDeferred = true;
+            gridDeferredRevision = positionRevision;
+            gridDrag += Eigen::Vector2f(dx, dy);
+        });
+        dragTransform = step * dragTransform;
+        pointer_x = x;
+        pointer_y = y;
+    }
+}
+
+// Select the triangles in the rectangle or the lasso, or record the drag of the selection
+void finishSelectionTool(){
+    if(selecting){
+        updateGrid();
+        selection.resize(V.cols()/3);
+        if(lassoSelection){
+            selection.addLasso(grid, V, selectionBand);
+        } else {
+            BoundingBox box = columnsBox(selectionBand, 0, selectionBand.cols());
+            selection.addBox(grid, V, box);
+        }
+        cout << selection.count << " triangles selected" << endl;
+        selectionBand.resize(2, 0);
+        selecting = false;
+        dirty.invalidate();
+    } else if(draggingSelection){
+        selection.runs(selectionRuns);
+        if(!dragTransform.isIdentity())
+            recordSelectionTransform(selectionRuns, dragTransform);
+        draggingSelection = false;
+        gridDeferred = false;
+    }
+    enableCursorTrack = false;
+}
+
+// Finish the pending edits before walking the history: the transform of the selected
+// triangle is applied and recorded, the triangle being inserted is dropped
+void settleEdits(){
+    if(no_of_clicks_insertion > 0){
+        unsigned int pending = no_of_clicks_insertion == 1 ? 2 : 3;
+        V.conservativeResize(Eigen::NoChange, V.cols()-pending);
+        C.conservativeResize(Eigen::NoChange, C.cols()-pending);
+        uploadVertices(0, V.cols());
+        no_of_clicks_insertion = 0;
+        drawObject = ObjectType::UNKNOWN;
+    }
+    updateChangesToSelectedObj();
+    selectedObjectIndex = -1;
+    no_of_clicks_translate = 0;
+    finishSelectionTool();
+    enableCursorTrack = false;
+}
+
+void setLayer(unsigned int first, float layer);
+void renumberLayers(const std::function<void()> &then = std::function<void()>());
+void replayOpacity(const CommandLog::Command &command, bool revert);
+void replayCompaction(const CommandLog::Command &command, bool revert);
+
+// Apply a recorded edit, or revert it
+void replayCommand(const CommandLog::Command &command, bool revert){
+    float values[triangleRecordSize];
+    switch(command.type){
+        case CommandLog::INSERT_TRIANGLE:
+        case CommandLog::DELETE_TRIANGLE:
+            if(revert == (command.type == CommandLog::INSERT_TRIANGLE)){
+                removeTriangle(command.index);
+            } else {
+                command.values(0, triangleRecordSize, values);
+                restoreTriangle(command.index, values);
+            }
+            break;
+        case CommandLog::TRANSFORM_TRIANGLE:{
+            command.values(0, 6, values);
+            Eigen::Matrix4f transform = unpackAffine(values);
+            transformTriangle(command.index, revert ? Eigen::Matrix4f(transform.inverse()) : transform);
+            }
+            break;
+        case CommandLog::TRANSFORM_TRIANGLES:{
+            command.values(0, 6, values);
+            Eigen::Matrix4f transform = unpackAffine(values);
+            selectionRuns.resize(command.index);
+            for(unsigned int r = 0; r < selectionRuns.size(); r++)
+                selectionRuns[r] = TriangleRun(command.data[6+2*r], command.data[7+2*r]);
+            transformTriangles(selectionRuns, revert ? Eigen::Matrix4f(transform.inverse()) : transform);
+            }
+            break;
+        case CommandLog::RECOLOR_VERTEX:
+            command.values(revert ? 0 : 3, 3, values);
+            C.col(command.index) << values[0], values[1], values[2];
+            uploadColors(command.index, 1);
+            break;
+        case CommandLog::SET_LAYER:
+            setLayer(command.index, command.value(revert ? 0 : 1));
+            break;
+        case CommandLog::CHANGE_OPACITY:
+            replayOpacity(command, revert);
+            break;
+        case CommandLog::COMPACT_LAYERS:
+            replayCompaction(command, revert);
+            break;
+    }
+}
+
+void undoEdit(){
+    if(indexedMode){
+        cout << "Undo only covers the triangle soup, press 'n' to leave the indexed mode" << endl;
+        return;
+    }
+    settleEdits();
+    CommandLog::Command command;
+    if(!history.undo(command)){
+        cout << "Nothing to undo" << endl;
+        return;
+    }
+    replayCommand(command, true);
+}
+
+void redoEdit(){
+    if(indexedMode)
+        return;
+    settleEdits();
+    CommandLog::Command command;
+    if(!history.redo(command)){
+        cout << "Nothing to redo" << endl;
+        return;
+    }
+    replayCommand(command, false);
+}
+
+void findNearestVertex(float click_x, float click_y) {
+    int nearest = nearestVertex(V, click_x, click_y);
+    if(nearest > -1)
+        selectedVertex = nearest;
+}
+
+Eigen::Vector2f interpolateKeyframe(Eigen::Vector2f previousFrame, Eigen::Vector2f currentFrame, float u){
+    Eigen::Vector2f intermediateFrame;
+    intermediateFrame = previousFrame * (1-u) + currentFrame * (u);
+    return intermediateFrame;
+};
+
+void resetToOriginalAfterAnimation(){
+    if(V.cols() > animatedVertex+2 && actionTriggered == Action::ANIMATION && animatedVertex > -1){
+        V.col(animatedVertex) = interpolateKeyframe(previousFrame.col(0), currentFrame.col(0), 0);
+        V.col(animatedVertex+1) = interpolateKeyframe(previousFrame.col(1), currentFrame.col(1), 0);
+        V.col(animatedVertex+2) = interpolateKeyframe(previousFrame.col(2), currentFrame.col(2), 0);
+        uploadVertices(animatedVertex, 3);
+    }
+};
+
+
+void initiateScaleKeyframe(){
+    if(animatedVertex > -1){
+        actionTriggered = Action::ANIMATION;
+        interpolateInterval = 0.0;
+        float px, py;
+        centroid_of_triangle(V.col(animatedVertex).x(), V.col(animatedVertex).y(), V.col(animatedVertex+1).x(), V.col(animatedVertex+1).y(), V.col(animatedVertex+2).x(), V.col(animatedVertex+2).y(), px, py);
+        Eigen::Matrix4f view = translate(px, py) * scale(2) * translate(-px, -py);
+        for(unsigned int i = 0; i<3; i++){
+            previousFrame.col(i) = V.col(animatedVertex+i);
+            Eigen::Vector4f tempV;
+            tempV << V.col(animatedVertex+i).x(), V.col(animatedVertex+i).y(), 0.0, 1.0;
+            Eigen::Vector4f tempPosition = view * tempV;
+            currentFrame.col(i) << tempPosition.x(), tempPosition.y();
+        }
+        
+        // Save the current time
+        t_start = std::chrono::high_resolution_clock::now();
+    }
+};
+
+void initiateRotationKeyframe(){
+    if(animatedVertex > -1){
+        actionTriggered = Action::ANIMATION;
+        interpolateInterval = 0.0;
+        float px, py;
+        centroid_of_triangle(V.col(animatedVertex).x(), V.col(animatedVertex).y(), V.col(animatedVertex+1).x(), V.col(animatedVertex+1).y(), V.col(animatedVertex+2).x(), V.col(animatedVertex+2).y(), px, py);
+        Eigen::Matrix4f view = translate(px, py) * rotate(180) * translate(-px, -py);
+        for(unsigned int i = 0; i<3; i++){
+            previousFrame.col(i) = V.col(animatedVertex+i);
+            Eigen::Vector4f tempV;
+            tempV << V.col(animatedVertex+i).x(), V.col(animatedVertex+i).y(), 0.0, 1.0;
+            Eigen::Vector4f tempPosition = view * tempV;
+            currentFrame.col(i) << tempPosition.x(), tempPosition.y();
+        }
+        
+        // Save the current time
+        t_start = std::chrono::high_resolution_clock::now();
+    }
+};
+
+
+void uploadMesh(){
+    VBO_MESH.update(mesh.V.data(), 2, mesh.vertex_count);
+    VBO_MESH_C.update(mesh.C.data(), 3, mesh.vertex_count);
+
+    // Triangles first, then two indices per edge for the outlines
+    vector<unsigned int> edges;
+    mesh.edges(edges);
+    meshIndices = mesh.I;
+    meshIndices.insert(meshIndices.end(), edges.begin(), edges.end());
+    EBO_MESH.update(meshIndices);
+}
+
+void cycleVertexFormat(){
+    if(interleavedLayout){
+        cout << "Packed vertex formats need the separate buffer layout" << endl;
+        return;
+    }
+    vertexFormat = (vertexFormat + 1) % 3;
+    VertexFormat positions = vertexFormat == 1 ? FORMAT_HALF_FLOAT : vertexFormat == 2 ? FORMAT_UNORM16 : FORMAT_FLOAT32;
+    VertexFormat colors = vertexFormat == 0 ? FORMAT_FLOAT32 : FORMAT_UNORM8;
+    VBO.format = positions;
+    VBO_MESH.format = positions;
+    VBO_C.format = colors;
+    VBO_MESH_C.format = colors;
+    VBO.update(V);
+    VBO_C.update(C);
+    uploadMesh();
+
+    // The attribute types are recorded in the VAOs
+    VAO.bind();
+    program.bindVertexAttribArray("position", VBO);
+    program.bindVertexAttribArray("color", VBO_C);
+    VAO_MESH.bind();
+    program.bindVertexAttribArray("position", VBO_MESH);
+    program.bindVertexAttribArray("color", VBO_MESH_C);
+    VAO.bind();
+    cout << "Vertex format: " << vertexFormatNames[vertexFormat] << ", " << VBO.bytesPerColumn() + VBO_C.bytesPerColumn() << " bytes per vertex" << endl;
+}
+
+void toggleInterleavedLayout(){
+    if(!interleavedLayout && vertexFormat != 0){
+        // The interleaved layout stores 32-bit floats only
+        vertexFormat = 2;
+        cycleVertexFormat();
+    }
+    interleavedLayout = !interleavedLayout;
+    VAO.bind();
+    if(interleavedLayout){
+        uploadVertices(0, V.cols());
+        program.bindVertexAttribArray("position", VBO_VC, 2, 5*sizeof(float), 0);
+        program.bindVertexAttribArray("color", VBO_VC, 3, 5*sizeof(float), 2*sizeof(float));
+    } else {
+        uploadVertices(0, V.cols());
+        program.bindVertexAttribArray("position", VBO);
+        program.bindVertexAttribArray("color", VBO_C);
+    }
+    cout << (interleavedLayout ? "Interleaved vertex layout (one buffer)" : "Separate position and color buffers") << endl;
+}
+
+void toggleIndexedMode(){
+    if(no_of_clicks_insertion > 0){
+        cout << "Finish the triangle being inserted first" << endl;
+        return;
+    }
+    resetToOriginalAfterAnimation();
+    animatedVertex = -1;
+    selectedObjectIndex = -1;
+    selectedVertex = -1;
+    selectedMeshVertex = -1;
+    indexedMode = !indexedMode;
+
+    // Welding renumbers the triangles, the recorded indices would not match anymore
+    history.clear();
+    selection.clear();
+    if(indexedMode){
+        mesh.weld_epsilon = weldRadius;
+        mesh.fromSoup(V, C);
+        V.resize(2,0);
+        C.resize(3,0);
+        cout << "Indexed mode: " << mesh.triangles() << " triangles share " << mesh.vertex_count << " vertices instead of " << mesh.I.size() << endl;
+    } else {
+        mesh.toSoup(V, C);
+        mesh.clear();
+        cout << "Triangle soup mode" << endl;
+    }
+    uploadVertices(0, V.cols());
+    uploadMesh();
+}
+
+Eigen::Matrix4f sceneViewMatrix(){
+    return tileView * (setTotalView ? totalView : translate(0, 0));
+}
+
+// Box of the triangles of the indexed mesh sharing the vertex v
+BoundingBox meshVertexBox(unsigned int v){
+    BoundingBox box;
+    for(unsigned int t = 0; t < mesh.triangles(); t++){
+        if(mesh.I[3*t] != v && mesh.I[3*t+1] != v && mesh.I[3*t+2] != v)
+            continue;
+        for(unsigned int k = 0; k < 3; k++)
+            box.extend(mesh.V(0, mesh.I[3*t+k]), mesh.V(1, mesh.I[3*t+k]));
+    }
+    return box;
+}
+
+// Clear and scissor the part of the frame to redraw, and set drawBox to the part of the scene it shows
+void beginRedraw(){
+    Eigen::Matrix4f sceneView = sceneViewMatrix();
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    drawBox = visibleBox(sceneView);
+
+    // Outlines, edge antialiasing and points reach a few pixels past the triangles
+    int rect[4] = {0, 0, viewport[2], viewport[3]};
+    if(!dirty.everything)
+        dirty.screenRect(sceneView, viewport[2], viewport[3], int(outlineWidth) + 3, rect);
+    double area = double(rect[2]) * rect[3] / (double(viewport[2]) * viewport[3]);
+    if(area < 0.5){
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(rect[0], rect[1], rect[2], rect[3]);
+        drawBox = visibleBox(sceneView, 2.0f*rect[0]/viewport[2]-1, 2.0f*rect[1]/viewport[3]-1, 2.0f*(rect[0]+rect[2])/viewport[2]-1, 2.0f*(rect[1]+rect[3])/viewport[3]-1);
+        partialRedraws++;
+        partialRedrawArea += area;
+    } else {
+        fullRedraws++;
+    }
+
+    glClearColor(backgroundColor.x(), backgroundColor.y(), backgroundColor.z(), 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void endRedraw(){
+    glDisable(GL_SCISSOR_TEST);
+    dirty.clear();
+}
+
+bool animating(){
+    return V.cols() > animatedVertex+2 && actionTriggered == Action::ANIMATION && animatedVertex > -1;
+}
+
+// Seconds until the next animation step
+double keyframeDelay(){
+    auto t_now = std::chrono::high_resolution_clock::now();
+    return max(0.0, 0.10 - std::chrono::duration_cast<std::chrono::duration<double>>(t_now - t_start).count());
+}
+
+// Shader features of the fills with the current outline and antialiasing settings
+unsigned int fillFeatures(int mode){
+    unsigned int features = 0;
+    if(mode != OutlineMode::LINE_PASS)
+        features |= SHADER_OUTLINE;
+    if(mode == OutlineMode::SINGLE_PASS_SMOOTH)
+        features |= SHADER_OUTLINE_SMOOTH;
+    if(antialiasing == Antialiasing::ANALYTIC)
+        features |= SHADER_EDGE_ANTIALIASING;
+    return features;
+}
+
+void cycleOutlineMode(){
+    // Skip the modes whose variant the driver cannot build
+    int mode = outlineMode;
+    do {
+        mode = (mode + 1) % 3;
+    } while(mode != OutlineMode::LINE_PASS && !shaders.available(fillFeatures(mode)));
+    outlineMode = mode;
+    cout << "Outlines: " << outlineModeNames[outlineMode] << endl;
+}
+
+// Program used for the triangle fills, set up with the current outline and antialiasing
+// settings. The analytic antialiasing blends the edges over what is behind them, so the
+// blending is left enabled and the fills must be drawn back to front
+Program &fillProgram(Program &program){
+    unsigned int features = fillFeatures(outlineMode);
+    Program *variant = features ? shaders.request(features) : NULL;
+    if(!variant)
+        return program;
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    variant->bind();
+    glUniform2f(variant->uniform("viewport"), viewport[2], viewport[3]);
+    glUniform1f(variant->uniform("outlineWidth"), outlineWidth);
+    glUniform3fv(variant->uniform("outlineColor"), 1, colorCode.col(0).data());
+    if(features & SHADER_EDGE_ANTIALIASING){
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    return *variant;
+}
+
+void cycleAntialiasing(){
+    // Skip the sample counts the driver does not support
+    do {
+        antialiasing = (antialiasing + 1) % 5;
+    } while(antialiasingSamples[antialiasing] > MultisampleTarget::maxSamples() || (antialiasing == Antialiasing::ANALYTIC && !shaders.available(fillFeatures(outlineMode))));
+    dirty.invalidate();
+    cout << "Antialiasing: " << antialiasingNames[antialiasing] << endl;
+}
+
+// Redirect the frame to the offscreen target of the current mode
+void beginAntialiasing(){
+    msaa.resize(framebufferWidth, framebufferHeight, antialiasingSamples[antialiasing]);
+    msaa.begin();
+}
+
+void resolveAntialiasing(){
+    msaa.resolve();
+}
+
+void cycleTransparencyMode(){
+    if(!oitSupported || !shaders.available(SHADER_WEIGHTED_OIT))
+        return;
+    transparencyMode = (transparencyMode + 1) % 3;
+    cout << "Transparency: " << transparencyModeNames[transparencyMode] << endl;
+}
+
+// Change the opacity of the selected triangle, or of every triangle when none is selected.
+// The history keeps the delta and the old opacities, the clamping loses them
+void changeOpacity(float delta){
+    bool selected = actionTriggered == Action::TRANSLATION && selectedObjectIndex > -1;
+    int first = selected ? selectedObjectIndex : 0;
+    int count = selected ? 3 : 3*(V.cols()/3);
+    if(count == 0)
+        return;
+    vector<float> record(count+1);
+    record[0] = delta;
+    Eigen::Map<Eigen::RowVectorXf>(&record[1], count) = A.middleCols(first, count);
+    history.push(CommandLog::CHANGE_OPACITY, first, &record[0], record.size());
+    for(int i = first; i < first+count; i++)
+        A(0, i) = min(1.0f, max(0.0f, A(0, i) + delta));
+    uploadColors(first, count);
+    cout << "Opacity: " << A(0, first) << (selected ? " for the selected triangle" : " for all the triangles") << endl;
+}
+
+void replayOpacity(const CommandLog::Command &command, bool revert){
+    float delta = command.value(0);
+    unsigned int count = command.count-1;
+    for(unsigned int i = 0; i < count; i++){
+        float old = command.value(1+i);
+        A(0, command.index+i) = revert ? old : min(1.0f, max(0.0f, old + delta));
+    }
+    uploadColors(command.index, count);
+}
+
+// Upload all the layers
+void uploadLayers(){
+    markBackStale(0, L.cols());
+    VBO_L.update(L);
+    layerRevision++;
+}
+
+// Renumber the layers of the soup 1, 2, ... keeping their order, then run then
+void renumberLayers(const std::function<void()> &then){
+    unsigned int triangles = V.cols()/3;
+    applySoupEdit(L.cols(), [triangles](Eigen::MatrixXf &, Eigen::MatrixXf &, Eigen::MatrixXf &, Eigen::MatrixXf &L){
+        vector<unsigned int> order(triangles);
+        for(unsigned int t = 0; t < order.size(); t++)
+            order[t] = t;
+        sort(order.begin(), order.end(), [&L](unsigned int a, unsigned int b){ return L(0, 3*a) < L(0, 3*b) || (L(0, 3*a) == L(0, 3*b) && a < b); });
+        for(unsigned int i = 0; i < order.size(); i++)
+            L.middleCols(3*order[i], 3).setConstant(i+1);
+    }, [triangles, then](){
+        topLayer = triangles;
+        uploadLayers();
+        if(then)
+            then();
+    });
+}
+
+// Renumber the layers once topLayer runs out of depth values, then run then. The old layers are
+// recorded, so that undoing past the compaction gives the earlier entries the layers they were made with
+void compactLayers(const std::function<void()> &then){
+    unsigned int triangles = V.cols()/3;
+    vector<float> record(triangles+1);
+    for(unsigned int t = 0; t < triangles; t++)
+        record[t] = L(0, 3*t);
+    record[triangles] = topLayer;
+    history.push(CommandLog::COMPACT_LAYERS, triangles, &record[0], record.size());
+    renumberLayers(then);
+}
+
+void replayCompaction(const CommandLog::Command &command, bool revert){
+    if(!revert){
+        renumberLayers();
+        return;
+    }
+    vector<float> layers(command.index+1);
+    command.values(0, layers.size(), &layers[0]);
+    applySoupEdit(L.cols(), [layers](Eigen::MatrixXf &, Eigen::MatrixXf &, Eigen::MatrixXf &, Eigen::MatrixXf &L){
+        for(unsigned int t = 0; t+1 < layers.size(); t++)
+            L.middleCols(3*t, 3).setConstant(layers[t]);
+    }, [layers](){
+        topLayer = layers.back();
+        uploadLayers();
+    });
+}
+
+// Write the three layers of the triangle at column first
+void setLayer(unsigned int first, float layer){
+    L.middleCols(first, 3).setConstant(layer);
+    markBackStale(first, 3);
+    VBO_L.updateColumns(L.col(first).data(), first, 3);
+    layerRevision++;
+    uploadedBytes += 3*VBO_L.bytesPerColumn();
+    topLayer = max(topLayer, layer);
+}
+
+// Stack the selected triangle on top of the others by writing its three layers
+void bringToFront(){
+    if(actionTriggered != Action::TRANSLATION || selectedObjectIndex < 0)
+        return;
+    // Stacked once the compaction is done
+    if(topLayer >= maxLayer){
+        compactLayers(bringToFront);
+        return;
+    }
+    float layers[2] = {L(0, selectedObjectIndex), topLayer+1};
+    history.push(CommandLog::SET_LAYER, selectedObjectIndex, layers, 2);
+    setLayer(selectedObjectIndex, layers[1]);
+}
+
+// Order triangles front to back, the later triangle first between equal layers,
+// or back to front. The culled triangles come in painting order, so without
+// restacking reversing them is enough. With a cache, the order is only computed
+// again when the triangles or the layers changed since the last call
+void sortByLayer(vector<unsigned int> &triangles, bool frontToBack, LayerOrder *cache = NULL){
+    if(cache && cache->revision == layerRevision && cache->frontToBack == frontToBack && cache->triangles == triangles){
+        triangles = cache->sorted;
+        return;
+    }
+    if(cache){
+        cache->triangles = triangles;
+        cache->revision = layerRevision;
+        cache->frontToBack = frontToBack;
+    }
+    auto inFront = [](unsigned int a, unsigned int b){ return L(0, 3*a) > L(0, 3*b) || (L(0, 3*a) == L(0, 3*b) && a > b); };
+    auto behind = [&inFront](unsigned int a, unsigned int b){ return inFront(b, a); };
+    if(frontToBack){
+        reverse(triangles.begin(), triangles.end());
+        if(!is_sorted(triangles.begin(), triangles.end(), inFront))
+            sort(triangles.begin(), triangles.end(), inFront);
+    } else if(!is_sorted(triangles.begin(), triangles.end(), behind)){
+        sort(triangles.begin(), triangles.end(), behind);
+    }
+    if(cache)
+        cache->sorted = triangles;
+}
+
+// Run write on the export thread, unless the previous export is still running
+bool startExport(const std::function<void()> &write){
+    if(exporting){
+        cout << "The previous export is still being written" << endl;
+        return false;
+    }
+    if(exportThread.joinable())
+        exportThread.join();
+    exporting = true;
+    exportThread = std::thread([write](){
+        write();
+        exporting = false;
+    });
+    return true;
+}
+
+// Wait for the file being exported, before exiting
+void finishExport(){
+    if(exportThread.joinable())
+        exportThread.join();
+}
+
+// Save a copy of the soup to scene.rscn on the export thread
+void saveScene(){
+    std::shared_ptr<Eigen::MatrixXf> positions = std::make_shared<Eigen::MatrixXf>(V);
+    std::shared_ptr<Eigen::MatrixXf> colors = std::make_shared<Eigen::MatrixXf>(C);
+    startExport([positions, colors](){
+        if(writeSceneFile("scene.rscn", *positions, *colors))
+            cout << "Scene saved to scene.rscn" << endl;
+    });
+}
+
+// The scene as seen in the window when scene.svg was requested
+struct SvgSnapshot
+{
+    Eigen::MatrixXf V, C, A;
+    vector<float> layers;
+    vector<unsigned int> order;
+    SvgOptions options;
+};
+
+// Write the triangles as seen in the window to scene.svg, stacked by layer. Only the copy
+// is taken here, the triangles are sorted and written on the export thread
+void exportSvg(){
+    std::shared_ptr<SvgSnapshot> snapshot = std::make_shared<SvgSnapshot>();
+    SvgOptions &options = snapshot->options;
+    options.width = windowWidth;
+    options.height = windowHeight;
+    options.view = sceneViewMatrix();
+    options.background = backgroundColor;
+    snapshot->V = V;
+    snapshot->C = C;
+    if(transparencyMode != TransparencyMode::OPAQUE){
+        snapshot->A = A;
+        options.alpha = &snapshot->A;
+    }
+
+    // The soup is in painting order until a triangle is brought to the front
+    unsigned int triangles = V.cols()/3;
+    for(unsigned int t = 1; t < triangles && snapshot->layers.empty(); t++){
+        if(L(0, 3*t) < L(0, 3*t-3)){
+            snapshot->layers.resize(triangles);
+            for(unsigned int i = 0; i < triangles; i++)
+                snapshot->layers[i] = L(0, 3*i);
+        }
+    }
+
+    startExport([snapshot](){
+        // Back to front like sortByLayer, the earlier triangle first between equal layers
+        const vector<float> &layers = snapshot->layers;
+        if(!layers.empty()){
+            snapshot->order.resize(layers.size());
+            for(unsigned int i = 0; i < layers.size(); i++)
+                snapshot->order[i] = i;
+            sort(snapshot->order.begin(), snapshot->order.end(), [&layers](unsigned int a, unsigned int b){
+                return layers[a] < layers[b] || (layers[a] == layers[b] && a < b);
+            });
+            snapshot->options.order = &snapshot->order;
+        }
+        SvgStats stats;
+        if(writeSvg("scene.svg", snapshot->V, snapshot->C, snapshot->options, &stats))
+            cout << "Scene exported to scene.svg: " << stats.triangles << " triangles, " << stats.bytes / (1024.0 * 1024.0) << " MB in " << stats.ms << " ms" << endl;
+    });
+}
+
+bool translucent(unsigned int t){
+    return A(0, 3*t) < 1 || A(0, 3*t+1) < 1 || A(0, 3*t+2) < 1;
+}
+
+// Blend count translucent triangles of the compacted index list starting at first over the opaque image
+void drawTranslucent(unsigned int first, unsigned int count, const Eigen::Matrix4f &view){
+    if(count == 0)
+        return;
+    // Until the accumulation variant is ready the translucent triangles are blended in list order
+    Program *accumulate = transparencyMode == TransparencyMode::WEIGHTED_BLENDED ? shaders.request(SHADER_WEIGHTED_OIT) : NULL;
+    if(!accumulate){
+        // The index list is sorted back to front in the sorted mode
+        program.bind();
+        glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+        glDrawElements(GL_TRIANGLES, 3*count, GL_UNSIGNED_INT, (void *)(sizeof(unsigned int)*3*first));
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+    } else {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        oit.resize(viewport[2], viewport[3]);
+        oit.begin();
+        accumulate->bind();
+        glUniformMatrix4fv(accumulate->uniform("view"), 1, GL_FALSE, view.data());
+        glUniform1f(accumulate->uniform("topLayer"), max(1.0f, topLayer));
+        glDrawElements(GL_TRIANGLES, 3*count, GL_UNSIGNED_INT, (void *)(sizeof(unsigned int)*3*first));
+        oit.composite();
+        VAO.bind();
+        program.bind();
+        glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
+    }
+}
+
+// Collect in visibleTriangles the triangles overlapping drawBox, the part of the scene redrawn
+void cullTriangles(){
+    auto t_cull = std::chrono::high_resolution_clock::now();
+    updateGrid();
+    visibleTriangles.clear();
+    grid.query(drawBox, visibleTriangles);
+    if(gridDeferred){
+        // The dragged triangles are in the grid where they were, found through the box moved back
+        BoundingBox before = drawBox;
+        before.min_x -= gridDrag.x();
+        before.max_x -= gridDrag.x();
+        before.min_y -= gridDrag.y();
+        before.max_y -= gridDrag.y();
+        unsigned int found = visibleTriangles.size();
+        grid.query(before, visibleTriangles);
+        unsigned int kept = found;
+        for(unsigned int i = found; i < visibleTriangles.size(); i++)
+            if(selection.contains(visibleTriangles[i]))
+                visibleTriangles[kept++] = visibleTriangles[i];
+        visibleTriangles.resize(kept);
+        inplace_merge(visibleTriangles.begin(), visibleTriangles.begin() + found, visibleTriangles.end());
+        visibleTriangles.erase(unique(visibleTriangles.begin(), visibleTriangles.end()), visibleTriangles.end());
+    }
+    auto t_now = std::chrono::high_resolution_clock::now();
+    cullStats.cull_ms = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(t_now - t_cull).count();
+    cullStats.total = V.cols()/3;
+    cullStats.visible = visibleTriangles.size();
+}
+
+void drawLod(Program &program, const Eigen::Matrix4f &sceneView){
+    lodLevel = -1;
+    lodCells = 0;
+    if(grid.triangle_bounds.empty())
+        return;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    float pixelsPerUnit = sceneView.block<2,1>(0,0).norm() * viewport[2] / 2;
+
+    // Only rebuild the pyramid when the finest level is small enough to be used
+    float finestCell = max((grid.bounds.max_x - grid.bounds.min_x) / grid.cells_x, (grid.bounds.max_y - grid.bounds.min_y) / grid.cells_y);
+    if(finestCell * pixelsPerUnit > lodCellPixels)
+        return;
+    if(!gridDeferred && (lod.revision != positionRevision || lod.color_revision != colorRevision)){
+        lod.build(grid, V, C, backgroundColor);
+        lod.revision = positionRevision;
+        lod.color_revision = colorRevision;
+    }
+
+    lodLevel = lod.selectLevel(pixelsPerUnit, lodCellPixels);
+    if(lodLevel < 0)
+        return;
+    float *quadPositions, *quadColors;
+    lodCells = lod.emitQuads(lodLevel, drawBox, frameArena, quadPositions, quadColors);
+    VBO_LOD.update(quadPositions, 2, 6*lodCells);
+    VBO_LOD_C.update(quadColors, 3, 6*lodCells);
+
+    VAO_LOD.bind();
+    glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, sceneView.data());
+    glDrawArrays(GL_TRIANGLES, 0, 6*lodCells);
+    VAO.bind();
+
+    // The triangles aggregated into the cells are not drawn one by one
+    float cellSize = lod.cellSize(lodLevel);
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < visibleTriangles.size(); i++){
+        if(lod.triangle_extent[visibleTriangles[i]] >= cellSize)
+            visibleTriangles[kept++] = visibleTriangles[i];
+    }
+    visibleTriangles.resize(kept);
+}
+
+void drawStreamedChunks(Program &program, const Eigen::Matrix4f &sceneView){
+    if(sceneFile.chunks.empty())
+        return;
+    glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, sceneView.data());
+    chunkCache.draw(program, drawBox, visibleBox(sceneView), frameNumber);
+    VAO.bind();
+}
+
+void drawIndexedMesh(Program &program, const Eigen::Matrix4f &sceneView){
+    if(mesh.triangles() == 0)
+        return;
+    GLint colorAttrib = program.attrib("color");
+    VAO_MESH.bind();
+    Eigen::Matrix4f meshView = sceneView * VBO_MESH.decode();
+    Program &fill = fillProgram(program);
+    glUniformMatrix4fv(fill.uniform("view"), 1, GL_FALSE, meshView.data());
+    glDrawElements(GL_TRIANGLES, mesh.I.size(), GL_UNSIGNED_INT, 0);
+    glDisable(GL_BLEND);
+    if(outlineMode == OutlineMode::LINE_PASS){
+        glDisableVertexAttribArray(colorAttrib);
+        glVertexAttrib3fv(colorAttrib, colorCode.col(0).data());
+        glDrawElements(GL_LINES, meshIndices.size()-mesh.I.size(), GL_UNSIGNED_INT, (void *)(sizeof(unsigned int)*mesh.I.size()));
+        glEnableVertexAttribArray(colorAttrib);
+    }
+    program.bind();
+    VAO.bind();
+}
+
+bool timerQuerySupported(){
+#ifdef __APPLE__
+    return true;
+#else
+    return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+#endif
+}
+
+void beginDrawTiming(){
+    drawTimeActive = false;
+    if(!drawTimeQuery[0])
+        return;
+
+    // The results of the earlier frames, oldest first, complete in order
+    for(unsigned int i = 0; i < drawTimeQueries; i++){
+        unsigned int q = (drawTimeNext + i) % drawTimeQueries;
+        if(!drawTimePending[q])
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(drawTimeQuery[q], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            break;
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(drawTimeQuery[q], GL_QUERY_RESULT, &elapsed);
+        drawTimePending[q] = false;
+        gpuDrawMs += elapsed / 1e6;
+        gpuDrawFrames++;
+        antialiasingGpuMs[drawTimeMode[q]] += elapsed / 1e6;
+        antialiasingFrames[drawTimeMode[q]]++;
+    }
+
+    // The GPU is more frames behind than there are queries, this frame is not timed
+    if(drawTimePending[drawTimeNext])
+        return;
+    drawTimeMode[drawTimeNext] = antialiasing;
+    glBeginQuery(GL_TIME_ELAPSED, drawTimeQuery[drawTimeNext]);
+    drawTimeActive = true;
+}
+
+void endDrawTiming(){
+    if(!drawTimeActive)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    drawTimePending[drawTimeNext] = true;
+    drawTimeNext = (drawTimeNext + 1) % drawTimeQueries;
 }
 
-void findNearestVertex(float click_x, float click_y) {
-    float nearDistance = 999999.0;
-    float distance;
-    for(unsigned int i = 0; i < V.cols(); i++){
-        distance = sqrt(pow(V.col(i).x() - click_x, 2) + pow(V.col(i).y() - click_y, 2));
-        if(distance < nearDistance){
-            selectedVertex = i;
-            nearDistance = distance;
-        }
+// Release the temporaries of the frame and count its heap allocations
+void endFrameAllocations(){
+    frameArena.reset();
+    unsigned long allocations = heapAllocations();
+    unsigned long frame = allocations - heapAllocationsAtSwap;
+    heapAllocationsAtSwap = allocations;
+    heapFrameAllocations += frame;
+    maxHeapFrameAllocations = max(maxHeapFrameAllocations, frame);
+    heapFrames++;
+}
+
+void printMetrics(){
+    cout << "Vertices: " << (interleavedLayout ? "interleaved layout" : "separate buffers") << ", " << uploadedBytes/1024 << " KB uploaded";
+    if(gpuDrawFrames > 0)
+        cout << ", " << gpuDrawMs / gpuDrawFrames << " ms GPU per frame over " << gpuDrawFrames << " frames";
+    cout << endl;
+    uploadedBytes = 0;
+    gpuDrawMs = 0;
+    gpuDrawFrames = 0;
+    cout << "Antialiasing: " << antialiasingNames[antialiasing];
+    for(int mode = 0; mode < 5; mode++){
+        if(antialiasingFrames[mode] > 0)
+            cout << ", " << antialiasingNames[mode] << " " << antialiasingGpuMs[mode] / antialiasingFrames[mode] << " ms GPU per frame";
     }
+    cout << endl;
+    cout << "Shaders: " << shaderVariantModeNames[shaders.mode] << ", " << shaders.linked() << " variants linked, " << shaders.building() << " being built" << endl;
+    cout << "History: " << history.undoableEntries() << " edits to undo, " << history.redoableEntries() << " to redo, " << history.bytes()/1024 << "/" << history.budget()/1024 << " KB" << endl;
+    if(indexedMode)
+        cout << "Indexed mesh: " << mesh.triangles() << " triangles, " << mesh.vertex_count << " shared vertices (" << (mesh.vertex_count*5*sizeof(float) + mesh.I.size()*sizeof(unsigned int))/1024 << " KB vs " << mesh.I.size()*5*sizeof(float)/1024 << " KB as a soup)" << endl;
+    if(!sceneFile.chunks.empty())
+        cout << "Streaming: " << chunkCache.drawn << "/" << sceneFile.chunks.size() << " chunks drawn, " << chunkCache.resident_bytes/1024 << "/" << chunkCache.budget/1024 << " KB resident, " << chunkCache.loads << " loads, " << chunkCache.evictions << " evictions, " << chunkCache.misses << " over budget" << endl;
+    cout << "Culling: " << cullStats.cull_ms << " ms, " << cullStats.visible << "/" << cullStats.total << " triangles visible, " << cullStats.culledPercent() << "% culled" << endl;
+    if(transparencyMode != TransparencyMode::OPAQUE)
+        cout << "Transparency: " << transparencyModeNames[transparencyMode] << ", " << translucentTriangles << " translucent triangles drawn" << endl;
+    double countSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - cursorCountStart).count();
+    cout << "Cursor: " << cursorEvents / countSeconds << " events/s, " << cursorUploads / countSeconds << " uploads/s (" << cursorEvents << " moves coalesced into " << cursorUploads << " uploads)" << endl;
+    cursorEvents = 0;
+    cursorUploads = 0;
+    cursorCountStart = std::chrono::steady_clock::now();
+    if(inputLatencyFrames > 0)
+        cout << "Input latency: " << inputLatencyMs / inputLatencyFrames << " ms on average, " << maxInputLatencyMs << " ms at most" << endl;
+    inputLatencyMs = 0;
+    maxInputLatencyMs = 0;
+    inputLatencyFrames = 0;
+    cout << "Redraws: " << fullRedraws << " full, " << partialRedraws << " partial";
+    if(partialRedraws > 0)
+        cout << " covering " << 100 * partialRedrawArea / partialRedraws << "% of the window on average";
+    cout << endl;
+    fullRedraws = 0;
+    partialRedraws = 0;
+    partialRedrawArea = 0;
+    if(heapFrames > 0)
+        cout << "Heap: " << (double) heapFrameAllocations / heapFrames << " allocations per frame on average, " << maxHeapFrameAllocations << " at most, " << frameArena.takePeak()/1024 << "/" << frameArena.capacity()/1024 << " KB of frame arena used at most" << endl;
+    heapFrameAllocations = 0;
+    maxHeapFrameAllocations = 0;
+    heapFrames = 0;
+    if(lodLevel > -1)
+        cout << "LOD: level " << lodLevel << ", " << lodCells << " aggregated cells, " << visibleTriangles.size() << " triangles drawn individually" << endl;
+    else
+        cout << "LOD: off" << endl;
+    if(idPicking)
+        cout << "Picking: object IDs, " << idPasses << " ID passes, " << pickWaits << " clicks waited for the readback" << endl;
+    else
+        cout << "Picking: triangle tests on the CPU" << endl;
+    idPasses = 0;
+    pickWaits = 0;
 }
 
-Eigen::Vector2f interpolateKeyframe(Eigen::Vector2f previousFrame, Eigen::Vector2f currentFrame, float u){
-    Eigen::Vector2f intermediateFrame;
-    intermediateFrame = previousFrame * (1-u) + currentFrame * (u);
-    return intermediateFrame;
-};
+void toggleIdPicking(){
+    if(!pickingSupported)
+        return;
+    idPicking = !idPicking;
+    hoverValid = false;
+    cout << (idPicking ? "Picking from the object ID buffer" : "Picking with triangle tests on the CPU") << endl;
+}
 
-void resetToOriginalAfterAnimation(){
-    if(V.cols() > animatedVertex+2 && actionTriggered == Action::ANIMATION && animatedVertex > -1){
-        V.col(animatedVertex) = interpolateKeyframe(previousFrame.col(0), currentFrame.col(0), 0);
-        V.col(animatedVertex+1) = interpolateKeyframe(previousFrame.col(1), currentFrame.col(1), 0);
-        V.col(animatedVertex+2) = interpolateKeyframe(previousFrame.col(2), currentFrame.col(2), 0);
-        VBO.update(V);
-    }
-};
+// Pixel of the framebuffer under the pointer, from the bottom left
+void pointerPixel(double xpos, double ypos, int &x, int &y){
+    x = int(xpos * framebufferWidth / max(windowWidth, 1));
+    y = framebufferHeight - 1 - int(ypos * framebufferHeight / max(windowHeight, 1));
+}
 
+// Draw the triangle IDs again if the soup, the stacking or the view changed since the last time.
+// The triangle being inserted is left out
+void updatePickIds(){
+    unsigned int triangles = V.cols()/3 - (drawObject == ObjectType::LINELOOP ? 1 : 0);
+    Eigen::Matrix4f idView = sceneViewMatrix() * (interleavedLayout ? VBO_VC.decode() : VBO.decode());
+    if(pickIds.current(positionRevision, topLayer, idView, framebufferWidth, framebufferHeight))
+        return;
+    pickIds.begin(idView, framebufferWidth, framebufferHeight);
+    VAO.bind();
+    glDrawArrays(GL_TRIANGLES, 0, 3*triangles);
+    pickIds.end(positionRevision, topLayer);
+    program.bind();
 
-void initiateScaleKeyframe(){
-    if(animatedVertex > -1){
-        actionTriggered = Action::ANIMATION;
-        interpolateInterval = 0.0;
-        float px, py;
-        centroid_of_triangle(V.col(animatedVertex).x(), V.col(animatedVertex).y(), V.col(animatedVertex+1).x(), V.col(animatedVertex+1).y(), V.col(animatedVertex+2).x(), V.col(animatedVertex+2).y(), px, py);
-        Eigen::Matrix4f view = translate(px, py) * scale(2) * translate(-px, -py);
-        for(unsigned int i = 0; i<3; i++){
-            previousFrame.col(i) = V.col(animatedVertex+i);
-            Eigen::Vector4f tempV;
-            tempV << V.col(animatedVertex+i).x(), V.col(animatedVertex+i).y(), 0.0, 1.0;
-            Eigen::Vector4f tempPosition = view * tempV;
-            currentFrame.col(i) << tempPosition.x(), tempPosition.y();
-        }
-        
-        // Save the current time
-        t_start = std::chrono::high_resolution_clock::now();
-    }
-};
+    // A readback still in flight shows the previous IDs
+    hoverPixel[0] = hoverPixel[1] = -1;
+    hoverValid = false;
+    idPasses++;
+}
 
-void initiateRotationKeyframe(){
-    if(animatedVertex > -1){
-        actionTriggered = Action::ANIMATION;
-        interpolateInterval = 0.0;
-        float px, py;
-        centroid_of_triangle(V.col(animatedVertex).x(), V.col(animatedVertex).y(), V.col(animatedVertex+1).x(), V.col(animatedVertex+1).y(), V.col(animatedVertex+2).x(), V.col(animatedVertex+2).y(), px, py);
-        Eigen::Matrix4f view = translate(px, py) * rotate(180) * translate(-px, -py);
-        for(unsigned int i = 0; i<3; i++){
-            previousFrame.col(i) = V.col(animatedVertex+i);
-            Eigen::Vector4f tempV;
-            tempV << V.col(animatedVertex+i).x(), V.col(animatedVertex+i).y(), 0.0, 1.0;
-            Eigen::Vector4f tempPosition = view * tempV;
-            currentFrame.col(i) << tempPosition.x(), tempPosition.y();
-        }
-        
-        // Save the current time
-        t_start = std::chrono::high_resolution_clock::now();
+// Collect the readback of the pixel under the pointer if it arrived
+void collectHover(){
+    int triangle;
+    if(pickIds.pending() && pickIds.result(triangle, false)){
+        hoverTriangle = triangle;
+        hoverValid = true;
     }
-};
+}
 
+// Start reading the triangle under the pointer, the result is collected by the next pick
+void hoverPick(double xpos, double ypos){
+    int x, y;
+    pointerPixel(xpos, ypos, x, y);
+    if(x == hoverPixel[0] && y == hoverPixel[1])
+        return;
+    updatePickIds();
+    pickIds.request(x, y);
+    hoverPixel[0] = x;
+    hoverPixel[1] = y;
+    hoverValid = false;
+}
 
-void cursor_position_callback(GLFWwindow *window, double xpos, double ypos)
+// First column of the topmost triangle drawn under the pointer, -1 if there is none. Waits for
+// the GPU only if the pixel was not read back while hovering
+int pickId(double xpos, double ypos){
+    int x, y;
+    pointerPixel(xpos, ypos, x, y);
+    updatePickIds();
+    collectHover();
+    if(!hoverValid || x != hoverPixel[0] || y != hoverPixel[1]){
+        pickIds.request(x, y);
+        hoverPixel[0] = x;
+        hoverPixel[1] = y;
+        hoverValid = pickIds.result(hoverTriangle, true);
+        pickWaits++;
+    }
+    return hoverValid && hoverTriangle > -1 ? 3*hoverTriangle : -1;
+}
+
+void handleCursorPosition(double xpos, double ypos)
 {
+    if(idPicking && actionTriggered == Action::TRANSLATION && !indexedMode && !enableCursorTrack)
+        hoverPick(xpos, ypos);
     if (enableCursorTrack)
     {
         // Get the size of the window
-        int width, height;
-        glfwGetWindowSize(window, &width, &height);
+        int width = windowWidth, height = windowHeight;
 
         // Convert screen position to world coordinates
         Eigen::Vector4f p_screen(xpos,height-1-ypos,0,1); // NOTE: y axis is flipped in glfw
@@ -257,6 +1833,8 @@ void cursor_position_callback(GLFWwindow *window, double xpos, double ypos)
         double yworld = p_world.y();
         
         if(actionTriggered == Action::INSERTION){
+            if(no_of_clicks_insertion == 1 || no_of_clicks_insertion == 2)
+                dirty.invalidate(columnsBox(V, V.cols()-3, 3));
             switch (no_of_clicks_insertion)
             {
                 case 1:
@@ -269,8 +1847,26 @@ void cursor_position_callback(GLFWwindow *window, double xpos, double ypos)
                     break;
             }
             // Upload the change to the GPU
-            VBO.update(V);
+            if(V.cols() > 0){
+                uploadVertices(V.cols()-1, 1);
+                cursorUploads++;
+            }
+            if(no_of_clicks_insertion == 1 || no_of_clicks_insertion == 2)
+                dirty.invalidate(columnsBox(V, V.cols()-3, 3));
+        } else if(actionTriggered == Action::TRANSLATION && indexedMode){
+            if(selectedMeshVertex > -1){
+                // Every triangle sharing the vertex follows with a single write
+                dirty.invalidate(meshVertexBox(selectedMeshVertex));
+                mesh.moveVertex(selectedMeshVertex, xworld, yworld);
+                dirty.invalidate(meshVertexBox(selectedMeshVertex));
+                if(!VBO_MESH.updateColumns(mesh.V.col(selectedMeshVertex).data(), selectedMeshVertex, 1))
+                    uploadMesh();
+                cursorUploads++;
+            }
+        } else if(actionTriggered == Action::TRANSLATION && (selecting || draggingSelection)){
+            moveSelectionTool(xworld, yworld);
         } else if(actionTriggered == Action::TRANSLATION){
+            Eigen::Matrix4f previousView = translateView;
             switch (no_of_clicks_translate)
             {
                 case 1:
@@ -283,19 +1879,20 @@ void cursor_position_callback(GLFWwindow *window, double xpos, double ypos)
                     break;
             }
             translateView = translate(translation_x, translation_y);
+            if(translateView != previousView){
+                dirty.invalidate(columnsBox(V, selectedObjectIndex, 3, previousView));
+                dirty.invalidate(columnsBox(V, selectedObjectIndex, 3, translateView));
+            }
         }
     }
 }
 
-void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
+void handleMouseButton(int button, int action, int mods, double xpos, double ypos)
 {
-    // Get the position of the mouse in the window
-    double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
+    dirty.invalidate();
 
     // Get the size of the window
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
+    int width = windowWidth, height = windowHeight;
     
     // Convert screen position to world coordinates
     Eigen::Vector4f p_screen(xpos,height-1-ypos,0,1); // NOTE: y axis is flipped in glfw
@@ -344,6 +1941,18 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
                 case 3:
                     V.col(V.cols()-1) << xworld, yworld;
                     updateObjectColor(C, V.cols()-3, colorCode.col(10));   //set traiangle color to red
+                    if(!indexedMode){
+                        float record[triangleRecordSize];
+                        saveTriangle(V.cols()-3, record);
+                        history.push(CommandLog::INSERT_TRIANGLE, V.cols()-3, record, triangleRecordSize);
+                    }
+                    if(indexedMode){
+                        // Weld the finished triangle into the mesh
+                        mesh.addTriangle(V, C, V.cols()-3);
+                        V.conservativeResize(Eigen::NoChange,V.cols()-3);
+                        C.conservativeResize(Eigen::NoChange,C.cols()-3);
+                        uploadMesh();
+                    }
                     drawObject = ObjectType::TRIANGLE;
                     enableCursorTrack = false;
                     no_of_clicks_insertion = 0;
@@ -356,9 +1965,45 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
                 break;
             }
         }
-        // Upload the change to the GPU
-        VBO.update(V);
-        VBO_C.update(C);
+        // Upload the change to the GPU, only the last triangle can have changed
+        unsigned int changed = min(3, (int)V.cols());
+        uploadVertices(V.cols()-changed, changed);
+    } else if(actionTriggered == Action::TRANSLATION && indexedMode) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT)
+        {
+            switch (action)
+            {
+                case GLFW_PRESS:
+                    selectedMeshVertex = mesh.nearestVertex(xworld, yworld, 2*weldRadius);
+                    enableCursorTrack = selectedMeshVertex > -1;
+                    break;
+                case GLFW_RELEASE:
+                    selectedMeshVertex = -1;
+                    enableCursorTrack = false;
+                    break;
+                default:
+                    break;
+            }
+        }
+    } else if(actionTriggered == Action::DELETION && indexedMode) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        {
+            int t = mesh.triangleAt(xworld, yworld);
+            if(t > -1){
+                mesh.removeTriangle(t);
+                uploadMesh();
+            }
+        }
+    } else if(actionTriggered == Action::COLOR_MODIFICATION && indexedMode) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_RELEASE)
+        {
+            selectedMeshVertex = mesh.nearestVertex(xworld, yworld, 999999.0);
+        }
+    } else if(actionTriggered == Action::TRANSLATION && button == GLFW_MOUSE_BUTTON_LEFT && (selecting || draggingSelection)) {
+        if(action == GLFW_RELEASE)
+            finishSelectionTool();
+    } else if(actionTriggered == Action::TRANSLATION && button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && startSelectionTool(mods, xworld, yworld)) {
+        // The press started a multi-selection or its drag
     } else if(actionTriggered == Action::TRANSLATION) {
         if (button == GLFW_MOUSE_BUTTON_LEFT)
         {
@@ -370,17 +2015,14 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
                     {
                         case 1:
                         {
-                            unsigned int triangleBlock = 0;
-                            for(unsigned int i = 0; i < V.cols()/3; i++){
-                                if(ptInTriangle(xworld, yworld, V.col(triangleBlock).x(), V.col(triangleBlock).y(), V.col(triangleBlock+1).x(), V.col(triangleBlock+1).y(), V.col(triangleBlock+2).x(), V.col(triangleBlock+2).y())){
-                                    pointer_x = xworld;
-                                    pointer_y = yworld;
-                                    selectedObjectIndex = triangleBlock;
-                                    enableCursorTrack = true;
-                                }
-                                triangleBlock = triangleBlock + 3;
-                                translateView = translate(0, 0);
+                            int picked = idPicking ? pickId(xpos, ypos) : pickTriangle(V, xworld, yworld);
+                            if(picked > -1){
+                                pointer_x = xworld;
+                                pointer_y = yworld;
+                                selectedObjectIndex = picked;
+                                enableCursorTrack = true;
                             }
+                            translateView = translate(0, 0);
                             break;
                         }
                         default:
@@ -416,25 +2058,8 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
             switch (action)
             {
                 case GLFW_PRESS:
-                {
-                    unsigned int triangleBlock = 0;
-                    for(unsigned int i = 0; i < V.cols()/3; i++){
-                        if(ptInTriangle(xworld, yworld, V.col(triangleBlock).x(), V.col(triangleBlock).y(), V.col(triangleBlock+1).x(), V.col(triangleBlock+1).y(), V.col(triangleBlock+2).x(), V.col(triangleBlock+2).y())){
-                            //remove all the three columns from V
-                            //note that for each removal matrix values shifts to the left and rearranges it's size
-                            removeColumn(V, triangleBlock); // removes first vertex of this block
-                            removeColumn(C, triangleBlock); // removes first vertex color of this block
-                            removeColumn(V, triangleBlock); // removes second vertex of this block
-                            removeColumn(C, triangleBlock); // removes second vertex color of this block
-                            removeColumn(V, triangleBlock); // removes third vertex of this block
-                            removeColumn(C, triangleBlock); //removes third vertex color of this block
-                            VBO.update(V);
-                            VBO_C.update(C);
-                        }
-                        triangleBlock = triangleBlock + 3;
-                    }
+                    deleteTrianglesAt(xworld, yworld);
                     break;
-                }
                 case GLFW_RELEASE:
                 default:
                     selectedObjectIndex = -1;
@@ -449,17 +2074,26 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
     }
 }
 
-void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+void exportPoster();
+
+void handleKey(int key, int scancode, int action, int mods)
 {
     if(action == GLFW_PRESS || action == GLFW_REPEAT){
+        dirty.invalidate();
         // Update the position of the first vertex if the keys 1,2, or 3 are pressed
         resetToOriginalAfterAnimation();
         animatedVertex = -1;
+        if(indexedMode && actionTriggered == Action::COLOR_MODIFICATION && selectedMeshVertex > -1 && key >= GLFW_KEY_1 && key <= GLFW_KEY_9){
+            // A shared vertex is recolored for all its triangles with a single write
+            mesh.C.col(selectedMeshVertex) << colorCode.col(key - GLFW_KEY_0);
+            VBO_MESH_C.updateColumns(mesh.C.col(selectedMeshVertex).data(), selectedMeshVertex, 1);
+        }
         switch (key)
         {
             case GLFW_KEY_I:
                 actionTriggered = Action::INSERTION;
                 updateChangesToSelectedObj();
+                selection.clear();
                 break;
             case GLFW_KEY_O:
                 actionTriggered = Action::TRANSLATION;
@@ -470,30 +2104,39 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             case GLFW_KEY_P:
                 actionTriggered = Action::DELETION;
                 updateChangesToSelectedObj();
+                selection.clear();
                 break;
             case GLFW_KEY_H:
-                if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
+                if(actionTriggered == Action::TRANSLATION && !selection.empty()){
+                    transformSelection(rotate(-10));
+                } else if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
                     float px, py;
                     centroid_of_triangle(V.col(selectedObjectIndex).x(), V.col(selectedObjectIndex).y(), V.col(selectedObjectIndex+1).x(), V.col(selectedObjectIndex+1).y(), V.col(selectedObjectIndex+2).x(), V.col(selectedObjectIndex+2).y(), px, py);
                     translateView = translate(px, py) * rotate(-10) * translate(-px, -py) * translateView;
                 }
                 break;
             case GLFW_KEY_J:
-                if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
+                if(actionTriggered == Action::TRANSLATION && !selection.empty()){
+                    transformSelection(rotate(10));
+                } else if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
                     float px, py;
                     centroid_of_triangle(V.col(selectedObjectIndex).x(), V.col(selectedObjectIndex).y(), V.col(selectedObjectIndex+1).x(), V.col(selectedObjectIndex+1).y(), V.col(selectedObjectIndex+2).x(), V.col(selectedObjectIndex+2).y(), px, py);
                     translateView = translate(px, py) * rotate(10) * translate(-px, -py) * translateView;
                 }
                 break;
             case GLFW_KEY_K:
-                if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
+                if(actionTriggered == Action::TRANSLATION && !selection.empty()){
+                    transformSelection(scale(1.25));
+                } else if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
                     float px, py;
                     centroid_of_triangle(V.col(selectedObjectIndex).x(), V.col(selectedObjectIndex).y(), V.col(selectedObjectIndex+1).x(), V.col(selectedObjectIndex+1).y(), V.col(selectedObjectIndex+2).x(), V.col(selectedObjectIndex+2).y(), px, py);
                     translateView = translate(px, py) * scale(1.25) * translate(-px, -py) * translateView;
                 }
                 break;
             case GLFW_KEY_L:
-                if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
+                if(actionTriggered == Action::TRANSLATION && !selection.empty()){
+                    transformSelection(scale(0.75));
+                } else if(actionTriggered == Action::TRANSLATION && selectedObjectIndex != -1){
                     float px, py;
                     centroid_of_triangle(V.col(selectedObjectIndex).x(), V.col(selectedObjectIndex).y(), V.col(selectedObjectIndex+1).x(), V.col(selectedObjectIndex+1).y(), V.col(selectedObjectIndex+2).x(), V.col(selectedObjectIndex+2).y(), px, py);
                     translateView = translate(px, py) * scale(0.75) * translate(-px, -py)* translateView;
@@ -502,60 +2145,52 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             case GLFW_KEY_C:
                 actionTriggered = Action::COLOR_MODIFICATION;
                 updateChangesToSelectedObj();
+                selection.clear();
                 selectedObjectIndex = -1;
                 break;
             case GLFW_KEY_1:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(1);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(1));
                 }
                 break;
             case GLFW_KEY_2:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(2);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(2));
                 }
                 break;
             case GLFW_KEY_3:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(3);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(3));
                 }
                 break;
             case GLFW_KEY_4:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(4);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(4));
                 }
                 break;
             case GLFW_KEY_5:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(5);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(5));
                 }
                 break;
             case GLFW_KEY_6:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(6);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(6));
                 }
                 break;
             case GLFW_KEY_7:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(7);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(7));
                 }
                 break;
             case GLFW_KEY_8:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(8);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(8));
                 }
                 break;
             case GLFW_KEY_9:
                 if(actionTriggered == Action::COLOR_MODIFICATION && selectedVertex > -1){
-                    C.col(selectedVertex) << colorCode.col(9);
-                    VBO_C.update(C);
+                    recolorVertex(selectedVertex, colorCode.col(9));
                 }
                 break;
             case GLFW_KEY_EQUAL:
@@ -573,8 +2208,7 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             case GLFW_KEY_W:{
                 setTotalView = true;
                 // Get the size of the window
-                int width, height;
-                glfwGetWindowSize(window, &width, &height);
+                int height = windowHeight;
                 float zeroCordY = (((height-1.0)/height)*2)-1;
                 float fullHeightCordY = ((-1.0/height)*2)-1;
                 float screenHeight = fullHeightCordY - zeroCordY;
@@ -584,8 +2218,7 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
             case GLFW_KEY_S:{
                 setTotalView = true;
                 // Get the size of the window
-                int width, height;
-                glfwGetWindowSize(window, &width, &height);
+                int height = windowHeight;
                 float zeroCordY = ((height-1.0)/height)*2-1;
                 float fullHeightCordY = ((-1.0)/height)*2-1;
                 float screenHeight = fullHeightCordY - zeroCordY;
@@ -604,7 +2237,18 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
                 totalView = totalView.isZero() ? translate(-0.2*screenWidth, 0) : translate(-0.2*screenWidth, 0) * totalView;
                 }
                 break;
+            case GLFW_KEY_Y:
+                if(mods & GLFW_MOD_CONTROL)
+                    redoEdit();
+                break;
             case GLFW_KEY_Z:{
+                if(mods & GLFW_MOD_CONTROL){
+                    if(mods & GLFW_MOD_SHIFT)
+                        redoEdit();
+                    else
+                        undoEdit();
+                    break;
+                }
                 animatedVertex = 0;
                 animationtype = "scale";
                 initiateScaleKeyframe();
@@ -616,6 +2260,56 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
                 initiateRotationKeyframe();
                 }
                 break;
+            case GLFW_KEY_M:
+                printMetrics();
+                break;
+            case GLFW_KEY_N:
+                toggleIndexedMode();
+                break;
+            case GLFW_KEY_F:
+                cycleVertexFormat();
+                break;
+            case GLFW_KEY_G:
+                toggleInterleavedLayout();
+                break;
+            case GLFW_KEY_U:
+                cycleOutlineMode();
+                break;
+            case GLFW_KEY_T:
+                cycleTransparencyMode();
+                break;
+            case GLFW_KEY_E:
+                bringToFront();
+                break;
+            case GLFW_KEY_Q:
+                cycleAntialiasing();
+                break;
+            case GLFW_KEY_COMMA:
+                changeOpacity(-0.1);
+                break;
+            case GLFW_KEY_PERIOD:
+                changeOpacity(0.1);
+                break;
+            case GLFW_KEY_RIGHT_BRACKET:
+                outlineWidth = min(outlineWidth + 0.5f, 8.0f);
+                cout << "Outline width: " << outlineWidth << " pixels" << endl;
+                break;
+            case GLFW_KEY_LEFT_BRACKET:
+                outlineWidth = max(outlineWidth - 0.5f, 0.5f);
+                cout << "Outline width: " << outlineWidth << " pixels" << endl;
+                break;
+            case GLFW_KEY_B:
+                saveScene();
+                break;
+            case GLFW_KEY_V:
+                exportSvg();
+                break;
+            case GLFW_KEY_R:
+                exportPoster();
+                break;
+            case GLFW_KEY_SLASH:
+                toggleIdPicking();
+                break;
             default:
                 break;
         }
@@ -628,11 +2322,13 @@ void processKeyframe(){
             auto t_now = std::chrono::high_resolution_clock::now();
             float time = std::chrono::duration_cast<std::chrono::duration<float>>(t_now - t_start).count();
             if(time >= 0.10){
+                int stepped = animatedVertex;
+                dirty.invalidate(columnsBox(V, stepped, 3));
                 //interpolate vertex values
                 V.col(animatedVertex) = interpolateKeyframe(previousFrame.col(0), currentFrame.col(0), interpolateInterval/10);
                 V.col(animatedVertex+1) = interpolateKeyframe(previousFrame.col(1), currentFrame.col(1), interpolateInterval/10);
                 V.col(animatedVertex+2) = interpolateKeyframe(previousFrame.col(2), currentFrame.col(2), interpolateInterval/10);
-                VBO.update(V);
+                uploadVertices(animatedVertex, 3);
                 t_start = std::chrono::high_resolution_clock::now();
                 if(interpolateInterval == 10 ){
                     //reset to original
@@ -646,59 +2342,577 @@ void processKeyframe(){
                 } else {
                     interpolateInterval++;
                 }
+                dirty.invalidate(columnsBox(V, stepped, 3));
+                dirty.invalidate(columnsBox(V, animatedVertex, 3));
             }
     }
 }
 
-Eigen::MatrixXf backupOriginalColor(3,11);
+void handleFramebufferSize(int width, int height)
+{
+    glViewport(0, 0, width, height);
+    dirty.invalidate();
+}
 
-void drawOutput(Program program)
+// Queue the events that found the queue full, true once none is left
+bool flushOverflowEvents()
 {
-        unsigned int triangleBlock = 0;
-        backupOriginalColor = C;
-        for(unsigned int i = 0; i < (V.cols()/3); i++){
-            // Draw a triangle
-            if(!(i == (V.cols()/3)-1 && drawObject == ObjectType::LINELOOP)){
-                if(selectedObjectIndex == triangleBlock){
-                    updateObjectColor(C, triangleBlock, colorCode.col(11));
-                    view = setTotalView && !totalView.isZero() ?  totalView * translateView : translateView;
-                } else {
-                    view = setTotalView ? totalView : translate(0, 0);
-                }
-                glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
-                glDrawArrays(GL_TRIANGLES, triangleBlock, 3);
+    while(!overflowEvents.empty() && events.push(overflowEvents.front()))
+        overflowEvents.pop_front();
+    return overflowEvents.empty();
+}
+
+// The GLFW callbacks run on the main thread and only queue the events. When the queue is full
+// they wait in overflowEvents, where a cursor move replaces the one that precedes it
+void postEvent(GLFWwindow *window, InputEvent event)
+{
+    glfwGetWindowSize(window, &event.width, &event.height);
+    glfwGetFramebufferSize(window, &event.framebuffer_width, &event.framebuffer_height);
+    event.time = std::chrono::steady_clock::now();
+    if(flushOverflowEvents() && events.push(event))
+        return;
+    if(event.type == InputEvent::CURSOR_POSITION && !overflowEvents.empty() && overflowEvents.back().type == InputEvent::CURSOR_POSITION)
+        overflowEvents.back() = event;
+    else
+        overflowEvents.push_back(event);
+}
+
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    InputEvent event(InputEvent::KEY);
+    event.key = key;
+    event.scancode = scancode;
+    event.action = action;
+    event.mods = mods;
+    postEvent(window, event);
+}
+
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
+{
+    InputEvent event(InputEvent::MOUSE_BUTTON);
+    event.key = button;
+    event.action = action;
+    event.mods = mods;
+    glfwGetCursorPos(window, &event.x, &event.y);
+    postEvent(window, event);
+}
+
+void cursor_position_callback(GLFWwindow *window, double xpos, double ypos)
+{
+    InputEvent event(InputEvent::CURSOR_POSITION);
+    event.x = xpos;
+    event.y = ypos;
+    postEvent(window, event);
+}
+
+void framebuffer_size_callback(GLFWwindow *window, int /*width*/, int /*height*/)
+{
+    InputEvent event(InputEvent::FRAMEBUFFER_SIZE);
+    postEvent(window, event);
+}
+
+void window_refresh_callback(GLFWwindow *window)
+{
+    InputEvent event(InputEvent::REFRESH);
+    postEvent(window, event);
+}
+
+// Move the scene to the last cursor position received, unless an edit runs
+void applyPendingCursor()
+{
+    if(cursorPending && !editThread.busy()){
+        cursorPending = false;
+        handleCursorPosition(pendingCursor[0], pendingCursor[1]);
+    }
+}
+
+// Apply the queued events to the scene, false once the window is closed. The time of
+// the oldest one is kept in oldest until a frame shows it. The events wait while an edit
+// runs on the edit thread, the first one applied after it finishes the edit
+bool applyEvents(std::chrono::steady_clock::time_point &oldest, bool &pending)
+{
+    publishEdit(false);
+    InputEvent event;
+    while(!editThread.busy() && (eventHeld || events.pop(event))){
+        if(eventHeld){
+            event = heldEvent;
+            eventHeld = false;
+        }
+        if(event.type == InputEvent::QUIT)
+            return false;
+        if(!pending)
+            oldest = event.time;
+        pending = true;
+        // The coalesced move is applied with the sizes it was received with
+        if(event.type != InputEvent::CURSOR_POSITION){
+            applyPendingCursor();
+            if(editThread.busy()){
+                heldEvent = event;
+                eventHeld = true;
+                break;
+            }
+        }
+        windowWidth = event.width;
+        windowHeight = event.height;
+        framebufferWidth = event.framebuffer_width;
+        framebufferHeight = event.framebuffer_height;
+        switch(event.type){
+            case InputEvent::KEY:
+                handleKey(event.key, event.scancode, event.action, event.mods);
+                break;
+            case InputEvent::MOUSE_BUTTON:
+                handleMouseButton(event.key, event.action, event.mods, event.x, event.y);
+                break;
+            case InputEvent::CURSOR_POSITION:
+                cursorEvents++;
+                pendingCursor[0] = event.x;
+                pendingCursor[1] = event.y;
+                cursorPending = true;
+                if(selecting && lassoSelection)
+                    applyPendingCursor();
+                break;
+            case InputEvent::FRAMEBUFFER_SIZE:
+                handleFramebufferSize(event.framebuffer_width, event.framebuffer_height);
+                break;
+            default:
+                dirty.invalidate();
+                break;
+        }
+    }
+    // The main thread may be waiting for room to queue events
+    if(events.overflowed())
+        glfwPostEmptyEvent();
+    return true;
+}
+
+void drawOutput(Program program);
+
+// Draw the parts of the frame marked dirty into the bound framebuffer
+void drawFrame(){
+    // Bind your VAO (not necessary if you have only one)
+    VAO.bind();
+
+    // Bind your program
+    program.bind();
+
+    // Clear the part of the framebuffer to redraw
+    beginDrawTiming();
+    beginAntialiasing();
+    // The flag of Eigen is shared by the threads, an edit running on the edit thread allocates
+    allowEigenMalloc(editThread.busy());
+    beginRedraw();
+    drawOutput(program);
+    endRedraw();
+    allowEigenMalloc(true);
+    resolveAntialiasing();
+    endDrawTiming();
+}
+
+// Body of the render thread: apply the queued events, draw the frame if something changed,
+// then sleep until the next event or step of the animation
+void renderLoop(GLFWwindow *window)
+{
+    glfwMakeContextCurrent(window);
+    std::chrono::steady_clock::time_point oldest;
+    bool pending = false;
+    heapAllocationsAtSwap = heapAllocations();
+    while(applyEvents(oldest, pending)){
+        applyPendingCursor();
+        if(!editThread.busy())
+            processKeyframe();
+
+        // Redraw with the shader variants that became ready
+        if(shaders.poll())
+            dirty.invalidate();
+
+        // Only redraw when something changed since the last frame
+        if(!dirty.empty()){
+            drawFrame();
+            if(idPicking)
+                updatePickIds();
+
+            // Swap front and back buffers
+            glfwSwapBuffers(window);
+            frameNumber++;
+            endFrameAllocations();
+            if(frameNumber == 1)
+                cout << "Startup: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count() << " ms to the first frame (" << (programCache.hits > 0 && programCache.misses == 0 ? "warm" : "cold") << " shader cache)" << endl;
+
+            if(pending){
+                double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - oldest).count();
+                inputLatencyMs += latency;
+                maxInputLatencyMs = max(maxInputLatencyMs, latency);
+                inputLatencyFrames++;
+                pending = false;
+            }
+        }
+
+        // Wait for the events, or until the next step of the animation. The variants being built are
+        // polled every few milliseconds. While an edit runs the events wait for it to be done
+        double timeout = animating() ? keyframeDelay() : -1;
+        if(shaders.building() > 0)
+            timeout = timeout < 0 ? 0.005 : min(timeout, 0.005);
+        if(editThread.busy())
+            editThread.wait(timeout);
+        else
+            events.wait(timeout);
+    }
+    glfwMakeContextCurrent(NULL);
+}
+
+// Draw the window contents at posterWidth pixels wide into poster.ppm. The tiles of a row are
+// drawn with their part of the view, culled like a frame, and cropped into one band of rows
+// written before the next row of tiles, so only a band is ever in memory
+void exportPoster(){
+    GLint maxRenderbuffer = 0, maxViewport[2] = {0, 0};
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    int side = min(posterTileSide, min<int>(maxRenderbuffer, min(maxViewport[0], maxViewport[1])));
+    PosterTiling tiling(posterWidth, max(1, int(double(posterWidth) * windowHeight / max(windowWidth, 1) + 0.5)), side);
+    PpmStream poster;
+    if(!poster.open("poster.ppm", tiling.width, tiling.height))
+        return;
+
+    auto begin = std::chrono::steady_clock::now();
+    int savedWidth = framebufferWidth, savedHeight = framebufferHeight;
+    framebufferWidth = framebufferHeight = side;
+    ImageTarget target;
+    target.init(side, side);
+    Image tile;
+    vector<unsigned char> band(3 * size_t(tiling.width) * side);
+    for(int row = 0; row < tiling.rows(); row++){
+        int rows = min(side, tiling.height - row*side);
+        for(int column = 0; column < tiling.columns(); column++){
+            int columns = min(side, tiling.width - column*side);
+            tileView = tiling.view(column, row);
+            target.bind();
+            dirty.invalidate();
+            drawFrame();
+            target.read(tile);
+            for(int y = 0; y < rows; y++)
+                std::copy(&tile.rgb[3 * size_t(y) * side], &tile.rgb[3 * (size_t(y) * side + columns)], &band[3 * (size_t(y) * tiling.width + column*side)]);
+        }
+        poster.write(&band[0], rows);
+    }
+    bool written = poster.close();
+
+    tileView = Eigen::Matrix4f::Identity();
+    target.free();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    framebufferWidth = savedWidth;
+    framebufferHeight = savedHeight;
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+    dirty.invalidate();
+    if(written)
+        cout << "Poster saved to poster.ppm: " << tiling.width << "x" << tiling.height << " pixels in " << tiling.columns()*tiling.rows() << " tiles of " << side << " pixels, " << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s" << endl;
+    else
+        cerr << "Cannot write poster.ppm" << endl;
+}
+
+// Replay the canonical scenes on the main thread into an offscreen image, compare the last frame
+// of each one with its golden image and time full redraws of it. Returns the exit code, nonzero
+// if an image differs or is missing, or a scene slowed down
+int runRegression()
+{
+    ImageTarget target;
+    target.init(regressionWidth, regressionHeight);
+    target.bind();
+    windowWidth = framebufferWidth = regressionWidth;
+    windowHeight = framebufferHeight = regressionHeight;
+    map<string, FrameStats> baseline;
+    if(!baselinePath.empty() && !readFrameStats(baselinePath, baseline))
+        cerr << "Cannot read the baseline " << baselinePath << endl;
+
+    vector<RegressionScene> scenes = canonicalScenes();
+    SceneTimes times;
+    int failures = 0;
+    std::chrono::steady_clock::time_point oldest;
+    bool pending = false;
+    for(unsigned int s = 0; s < scenes.size(); s++){
+        const RegressionScene &scene = scenes[s];
+
+        // One frame per event, the animation only moves in the steps so that the frames do not
+        // depend on the time taken to draw them
+        for(unsigned int e = 0; e < scene.events.size(); e++){
+            InputEvent event = scene.events[e];
+            event.width = event.framebuffer_width = regressionWidth;
+            event.height = event.framebuffer_height = regressionHeight;
+            event.time = std::chrono::steady_clock::now();
+            events.push(event);
+            // The frame shows the edits the event started
+            do {
+                publishEdit(true);
+                applyEvents(oldest, pending);
+                applyPendingCursor();
+            } while(editThread.busy() || eventHeld);
+            drawFrame();
+        }
+        for(unsigned int step = 0; step < scene.steps; step++){
+            t_start = std::chrono::high_resolution_clock::now() - std::chrono::milliseconds(100);
+            processKeyframe();
+            drawFrame();
+        }
+
+        vector<double> frameMs;
+        for(unsigned int f = 0; f < timedFrames; f++){
+            auto begin = std::chrono::steady_clock::now();
+            dirty.invalidate();
+            drawFrame();
+            glFinish();
+            frameMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        }
+        FrameStats stats = FrameStats::of(frameMs);
+        times.push_back(make_pair(scene.name, stats));
+
+        Image actual, golden, diff;
+        target.read(actual);
+        string golden_path = regressionDirectory + "/" + scene.name + ".ppm";
+        string result;
+        if(recordGoldens){
+            result = writePPM(golden_path, actual) ? "recorded " + golden_path : "cannot write " + golden_path;
+        } else if(!readPPM(golden_path, golden)){
+            writePPM(regressionDirectory + "/" + scene.name + ".actual.ppm", actual);
+            result = "FAILED, no golden image " + golden_path + " (--record writes it)";
+            failures++;
+        } else {
+            unsigned int differing = differingPixels(golden, actual, pixelTolerance, &diff);
+            if(differing > differingFraction * actual.width * actual.height){
+                writePPM(regressionDirectory + "/" + scene.name + ".actual.ppm", actual);
+                writePPM(regressionDirectory + "/" + scene.name + ".diff.ppm", diff);
+                result = "FAILED, " + to_string(differing) + " pixels differ";
+                failures++;
+            } else {
+                result = "matches";
+            }
+        }
+        cout << "Scene " << scene.name << ": image " << result << ", median " << stats.median_ms << " ms, p95 " << stats.p95_ms << " ms";
+        map<string, FrameStats>::const_iterator base = baseline.find(scene.name);
+        if(base != baseline.end() && base->second.median_ms > 0){
+            double change = stats.median_ms / base->second.median_ms - 1;
+            cout << " (" << (change >= 0 ? "+" : "") << 100 * change << "% from the baseline)";
+            if(change > slowdownThreshold){
+                cout << " SLOWER";
+                failures++;
             }
-            updateObjectColor(C, triangleBlock, colorCode.col(0));
-            glDrawArrays(GL_LINE_LOOP, triangleBlock, 3);
-            triangleBlock = triangleBlock + 3;
         }
-        C = backupOriginalColor;
-        VBO_C.update(C);
+        cout << endl;
+    }
+
+    if(!frameTimesPath.empty() && !writeFrameStats(frameTimesPath, times))
+        cerr << "Cannot write the frame times to " << frameTimesPath << endl;
+    cout << "Regression: " << (failures ? to_string(failures) + " failures" : string("passed")) << endl;
+    target.free();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return failures ? 1 : 0;
+}
+
+void drawOutput(Program program)
+{
+        Eigen::Matrix4f sceneView = sceneViewMatrix();
+        Eigen::Matrix4f selectedView = tileView * (setTotalView && !totalView.isZero() ?  totalView * translateView : translateView);
+        Eigen::Matrix4f decode = interleavedLayout ? VBO_VC.decode() : VBO.decode();
+        selectedView = selectedView * decode;
+        drawStreamedChunks(program, sceneView);
+        drawIndexedMesh(program, sceneView);
+        cullTriangles();
+
+        // Zoomed out, the sub-pixel triangles are replaced by the aggregated cells
+        drawLod(program, sceneView);
+
+        bool linePass = outlineMode == OutlineMode::LINE_PASS;
+        bool blended = transparencyMode != TransparencyMode::OPAQUE;
+        int triangles = V.cols()/3;
+        int pendingTriangle = drawObject == ObjectType::LINELOOP ? triangles-1 : -1;
+        int selectedTriangle = selectedObjectIndex > -1 && selectedObjectIndex/3 < triangles ? selectedObjectIndex/3 : -1;
+
+        // Compact the visible triangles into one index list: the opaque fills first, front
+        // to back so that early-Z rejects their hidden fragments (back to front with the
+        // analytic antialiasing, which blends their edges), the translucent fills back
+        // to front, then the outlines. With single pass outlines only the triangle being
+        // inserted and the translucent triangles need lines
+        drawIndices.clear();
+        sortedTriangles.clear();
+        for(unsigned int i = 0; i < visibleTriangles.size(); i++){
+            int t = visibleTriangles[i];
+            if(t != pendingTriangle && t != selectedTriangle && !(blended && translucent(t)))
+                sortedTriangles.push_back(t);
+        }
+        sortByLayer(sortedTriangles, antialiasing != Antialiasing::ANALYTIC, &opaqueOrder);
+        for(unsigned int i = 0; i < sortedTriangles.size(); i++){
+            unsigned int t = sortedTriangles[i];
+            unsigned int fill[3] = {3*t, 3*t+1, 3*t+2};
+            drawIndices.insert(drawIndices.end(), fill, fill+3);
+        }
+        unsigned int fills = drawIndices.size()/3;
+        sortedTriangles.clear();
+        for(unsigned int i = 0; blended && i < visibleTriangles.size(); i++){
+            int t = visibleTriangles[i];
+            if(t != pendingTriangle && t != selectedTriangle && translucent(t))
+                sortedTriangles.push_back(t);
+        }
+        if(transparencyMode == TransparencyMode::SORTED)
+            sortByLayer(sortedTriangles, false, &translucentOrder);
+        for(unsigned int i = 0; i < sortedTriangles.size(); i++){
+            unsigned int t = sortedTriangles[i];
+            unsigned int fill[3] = {3*t, 3*t+1, 3*t+2};
+            drawIndices.insert(drawIndices.end(), fill, fill+3);
+        }
+        translucentTriangles = sortedTriangles.size();
+        for(unsigned int i = 0; i < visibleTriangles.size(); i++){
+            unsigned int t = visibleTriangles[i];
+            if((int)t == selectedTriangle || (!linePass && (int)t != pendingTriangle && !(blended && translucent(t))))
+                continue;
+            unsigned int edges[6] = {3*t, 3*t+1, 3*t+1, 3*t+2, 3*t+2, 3*t};
+            drawIndices.insert(drawIndices.end(), edges, edges+6);
+        }
+
+        // The multi-selection is outlined on top of the other outlines
+        unsigned int lines = drawIndices.size();
+        for(unsigned int i = 0; !selection.empty() && i < visibleTriangles.size(); i++){
+            unsigned int t = visibleTriangles[i];
+            if(!selection.contains(t))
+                continue;
+            unsigned int edges[6] = {3*t, 3*t+1, 3*t+1, 3*t+2, 3*t+2, 3*t};
+            drawIndices.insert(drawIndices.end(), edges, edges+6);
+        }
+        EBO.update(drawIndices);
+
+        // Both programs bind the attributes to the same locations, so they share the VAO
+        GLint colorAttrib = program.attrib("color");
+        Program &fill = fillProgram(program);
+        view = sceneView * decode;
+        glUniformMatrix4fv(fill.uniform("view"), 1, GL_FALSE, view.data());
+        if(selectedTriangle > -1){
+            // The selected triangle follows the pointer and is highlighted with a constant color
+            glUniformMatrix4fv(fill.uniform("view"), 1, GL_FALSE, selectedView.data());
+            glDisableVertexAttribArray(colorAttrib);
+            glVertexAttrib3fv(colorAttrib, colorCode.col(11).data());
+            glDrawArrays(GL_TRIANGLES, 3*selectedTriangle, 3);
+            glEnableVertexAttribArray(colorAttrib);
+            glUniformMatrix4fv(fill.uniform("view"), 1, GL_FALSE, view.data());
+        }
+        glDrawElements(GL_TRIANGLES, 3*fills, GL_UNSIGNED_INT, 0);
+        glDisable(GL_BLEND);
+        drawTranslucent(fills, translucentTriangles, view);
+
+        // The outlines and the primitives being inserted stay on top as before
+        glDisable(GL_DEPTH_TEST);
+
+        // The geometry shader only takes triangles, lines and points go through the plain program
+        if(&fill != &program){
+            program.bind();
+            glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
+        }
+
+        // Draw the outlines with a constant color instead of overwriting C
+        glDisableVertexAttribArray(colorAttrib);
+        glVertexAttrib3fv(colorAttrib, colorCode.col(0).data());
+        unsigned int outlines = 3*(fills+translucentTriangles);
+        glDrawElements(GL_LINES, lines-outlines, GL_UNSIGNED_INT, (void *)(sizeof(unsigned int)*outlines));
+        if(drawIndices.size() > lines){
+            glVertexAttrib3fv(colorAttrib, colorCode.col(11).data());
+            glDrawElements(GL_LINES, drawIndices.size()-lines, GL_UNSIGNED_INT, (void *)(sizeof(unsigned int)*lines));
+        }
+        if(linePass && selectedTriangle > -1){
+            glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, selectedView.data());
+            glDrawArrays(GL_LINE_LOOP, 3*selectedTriangle, 3);
+            glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
+        }
+        glEnableVertexAttribArray(colorAttrib);
+
         switch (drawObject)
         {
             case POINT:
                 // Draw a point
-                glDrawArrays(GL_POINTS, triangleBlock, 1);
+                glDrawArrays(GL_POINTS, 3*triangles, 1);
                 break;
             case LINE:
                 // Draw a line
-                glDrawArrays(GL_LINES, triangleBlock, 2);
+                glDrawArrays(GL_LINES, 3*triangles, 2);
                 break;
             default:
                 break;
         }
+
+        // Rectangle or lasso being drawn
+        if(selecting && selectionBand.cols() > 1){
+            VBO_BAND.update(selectionBand);
+            VAO_BAND.bind();
+            glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, sceneView.data());
+            glVertexAttrib3fv(colorAttrib, colorCode.col(11).data());
+            glDrawArrays(GL_LINE_LOOP, 0, selectionBand.cols());
+            VAO.bind();
+        }
+        glEnable(GL_DEPTH_TEST);
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
     GLFWwindow *window;
+    launchTime = std::chrono::steady_clock::now();
+
+    // --scene <file> streams a chunked scene file, --budget-mb <n> caps the GPU memory it may use
+    // --import <file.obj|file.csv> adds the triangles of a text file to the soup, repeatable
+    // --aa none|2|4|8|analytic selects the antialiasing
+    string scenePath;
+    double budgetMB = 256;
+    vector<string> importPaths;
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if(arg == "--scene" && i+1 < argc)
+            scenePath = argv[++i];
+        else if(arg == "--poster" && i+1 < argc)
+            posterWidth = max(1, atoi(argv[++i]));
+        else if(arg == "--import" && i+1 < argc)
+            importPaths.push_back(argv[++i]);
+        else if(arg == "--budget-mb" && i+1 < argc)
+            budgetMB = atof(argv[++i]);
+        else if(arg == "--shader-cache" && i+1 < argc)
+            shaderCacheDirectory = argv[++i] == string("none") ? "" : argv[i];
+        else if(arg == "--history-mb" && i+1 < argc)
+            history.setBudget(size_t(atof(argv[++i]) * 1024 * 1024));
+        else if(arg == "--regress" && i+1 < argc)
+            regressionDirectory = argv[++i];
+        else if(arg == "--record")
+            recordGoldens = true;
+        else if(arg == "--frame-times" && i+1 < argc)
+            frameTimesPath = argv[++i];
+        else if(arg == "--baseline" && i+1 < argc)
+            baselinePath = argv[++i];
+        else if(arg == "--slowdown" && i+1 < argc)
+            slowdownThreshold = atof(argv[++i]);
+        else if(arg == "--tolerance" && i+1 < argc)
+            pixelTolerance = atoi(argv[++i]);
+        else if(arg == "--aa" && i+1 < argc){
+            string mode = argv[++i];
+            if(mode == "none")
+                antialiasing = Antialiasing::NO_ANTIALIASING;
+            else if(mode == "2")
+                antialiasing = Antialiasing::MSAA_2X;
+            else if(mode == "4")
+                antialiasing = Antialiasing::MSAA_4X;
+            else if(mode == "8")
+                antialiasing = Antialiasing::MSAA_8X;
+            else if(mode == "analytic")
+                antialiasing = Antialiasing::ANALYTIC;
+            else
+                cerr << "Unknown antialiasing " << mode << ", expected none|2|4|8|analytic" << endl;
+        }
+    }
+
+#ifdef RASTERIZATION_HEADLESS
+    // The headless renderer only draws the regression scenes, by default those of regression/
+    if(regressionDirectory.empty())
+        regressionDirectory = "regression";
+#endif
 
     // Initialize the library
+    int noDisplay = regressionDirectory.empty() ? -1 : regressionSkipped;
     if (!glfwInit())
-        return -1;
+        return noDisplay;
 
-    // Activate supersampling
-    glfwWindowHint(GLFW_SAMPLES, 8);
+    // The window is single sampled, the multisampling is done offscreen by MultisampleTarget
+    glfwWindowHint(GLFW_SAMPLES, 0);
 
     // Ensure that we get at least a 3.2 context
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -710,12 +2924,16 @@ int main(void)
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    // The regression scenes are drawn offscreen, the window only provides the context
+    if(!regressionDirectory.empty())
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
     // Create a windowed mode window and its OpenGL context
     window = glfwCreateWindow(640, 480, "Assignment2_Task5", NULL, NULL);
     if (!window)
     {
         glfwTerminate();
-        return -1;
+        return noDisplay;
     }
 
     // Make the window's context current
@@ -743,6 +2961,17 @@ int main(void)
     
     cout << "******* Task5: Add keyframing *******" << endl;
     cout << "Press key 'z' to initiate scale up animation and key 'x' to initiate rotate and zoom in/out animation effect.  Triangles will take animation effect one after the other. Press any other key to stop animation. " << endl;
+    cout << "Press key 'm' to print the rendering metrics, key 'b' to save the scene to scene.rscn, key 'v' to export it as seen to scene.svg and key 'r' to poster.ppm." << endl;
+    cout << "Press key 'n' to toggle the indexed mode, where triangles share welded vertices that can be dragged in translation mode." << endl;
+    cout << "Press key 'f' to cycle the vertex storage format between 32-bit floats and packed half-float/16-bit positions with RGBA8 colors." << endl;
+    cout << "Press key 'g' to switch between separate position/color buffers and one interleaved buffer." << endl;
+    cout << "Press key 'q' to cycle the antialiasing between none, 2x/4x/8x MSAA and analytic edges, key 'm' reports the GPU time of each mode used." << endl;
+    cout << "Press key 'e' in translation mode to bring the selected triangle to the front." << endl;
+    cout << "Press key 't' to cycle the transparency between off, weighted blended order-independent and sorted blending, and keys ',' and '.' to change the opacity of the selected triangle (or of all the triangles)." << endl;
+    cout << "In translation mode, shift+drag selects the triangles in a rectangle and ctrl+drag those in a lasso; drag a selected triangle to move the selection and press 'h'/'j'/'k'/'l' to rotate or scale it around its centroid." << endl;
+    cout << "Press ctrl+z to undo the last insertion, deletion, transform, recoloring, opacity change or restacking of a triangle, and ctrl+y or ctrl+shift+z to redo it." << endl;
+    cout << "Press key 'u' to cycle the outlines between a GL_LINES pass and single pass shaded edges, and keys '[' and ']' to change their width." << endl;
+    cout << "Press key '/' to pick the triangles in translation mode from a buffer of object IDs drawn by the GPU instead of testing them on the CPU." << endl;
     colorCode <<
     0.0, 0.0, 1.0, 0.0, 1.0, 1.0, 0.5, 0.0, 0.5, 0.75,  1.0, 0.0,
     0.0, 1.0, 1.0, 1.0, 0.0, 1.0, 0.5, 0.5, 0.0, 0.75,  0.0, 0.0,
@@ -758,7 +2987,6 @@ int main(void)
     // attributes are stored in a Vertex Buffer Object (or VBO). This means that
     // the VAO is not the actual object storing the vertex data,
     // but the descriptor of the vertex data.
-    VertexArrayObject VAO;
     VAO.init();
     VAO.bind();
 
@@ -771,35 +2999,57 @@ int main(void)
     VBO_C.init();
     C.resize(3,0);
     VBO_C.update(C);
+
+    VBO_A.init();
+    A.resize(1,0);
+    VBO_A.update(A);
+
+    VBO_L.init();
+    L.resize(1,0);
+    VBO_L.update(L);
+    backStale.reserve(maxBackStale);
+
+    // The element buffer is recorded in the VAO together with the attributes
+    EBO.init();
+
+    VBO_VC.init();
+    if(timerQuerySupported())
+        glGenQueries(drawTimeQueries, drawTimeQuery);
     
     // Initialize the OpenGL Program
     // A program controls the OpenGL pipeline and it must contains
-    // at least a vertex shader and a fragment shader to be valid
-    Program program;
-    const GLchar *vertex_shader =
-        "#version 150 core\n"
-        "in vec2 position;"
-        "uniform mat4 view;"
-        "in vec3 color;"
-        "out vec3 f_color;"
-        "void main()"
-        "{"
-        "    gl_Position = view * vec4(position, 0.0, 1.0);"
-        "    f_color = color;"
-        "}";
-    const GLchar *fragment_shader =
-        "#version 150 core\n"
-        "in vec3 f_color;"
-        "out vec4 outColor;"
-        "void main()"
-        "{"
-        "    outColor = vec4(f_color, 1.0);"
-        "}";
-
-    // Compile the two shaders and upload the binary to the GPU
-    // Note that we have to explicitly specify that the output "slot" called outColor
-    // is the one that we want in the fragment buffer (and thus on screen)
-    program.init(vertex_shader, fragment_shader, "outColor");
+    // at least a vertex shader and a fragment shader to be valid.
+    // The programs are variants of one shader with only the features of their draws
+    // compiled in, the attributes are bound to the same locations in all of them
+    vector<string> attributes = {"position", "color", "alpha", "layer"};
+    programCache.init(shaderCacheDirectory);
+    shaders.init(attributes, &programCache);
+    program = shaders.get(0);
+    if(programCache.enabled())
+        cout << "Shaders: " << programCache.init_ms.load() << " ms, " << programCache.hits << " programs from the cache in " << shaderCacheDirectory << ", " << programCache.misses << " compiled" << endl;
+    else
+        cout << "Shaders: " << programCache.init_ms.load() << " ms, compiled without cache" << endl;
+
+    // The other variants are all submitted now and built in parallel, the draws use the plain
+    // program until theirs is ready. The regression scenes build them on first use so that
+    // their frames always use the same variants
+    ShaderVariants::Mode shaderMode = regressionDirectory.empty() ? shaders.startParallel(window) : ShaderVariants::SYNCHRONOUS;
+    cout << "Shader variants: " << shaderVariantModeNames[shaderMode] << endl;
+    for(int mode = 0; mode < 3; mode++){
+        shaders.request(fillFeatures(mode) & ~SHADER_EDGE_ANTIALIASING);
+        shaders.request(fillFeatures(mode) | SHADER_EDGE_ANTIALIASING);
+    }
+    shaders.request(SHADER_WEIGHTED_OIT);
+    while(antialiasingSamples[antialiasing] > MultisampleTarget::maxSamples())
+        antialiasing--;
+    if(antialiasing == Antialiasing::ANALYTIC && !shaders.available(SHADER_EDGE_ANTIALIASING))
+        antialiasing = Antialiasing::NO_ANTIALIASING;
+    pickingSupported = pickIds.init(attributes);
+    if(!pickingSupported)
+        cerr << "Object ID picking is not available" << endl;
+    oitSupported = oit.init();
+    if(!oitSupported)
+        cerr << "Order-independent transparency is not available" << endl;
     program.bind();
 
     // The vertex shader wants the position of the vertices as an input.
@@ -807,47 +3057,130 @@ int main(void)
     // in the vertex shader
     program.bindVertexAttribArray("position", VBO);
     program.bindVertexAttribArray("color", VBO_C);
+    program.bindVertexAttribArray("alpha", VBO_A);
+    program.bindVertexAttribArray("layer", VBO_L);
     view = translate(0.0, 0.0);
     glUniformMatrix4fv(program.uniform("view"), 1, GL_FALSE, view.data());
 
-    // Register the keyboard callback
-    glfwSetKeyCallback(window, key_callback);
+    // The buffers without opacities are drawn opaque, at the back
+    glVertexAttrib1f(program.attrib("alpha"), 1.0);
+    glVertexAttrib1f(program.attrib("layer"), 0.0);
 
-    // Register the mouse callback
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    // Opaque fragments behind the ones already drawn are rejected before shading,
+    // equal depths keep the painting order of the buffers without layers
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
 
-    // Register the cursor position callback
-    glfwSetCursorPosCallback(window, cursor_position_callback);
+    // The aggregated cells are drawn from their own buffers
+    VAO_LOD.init();
+    VAO_LOD.bind();
+    VBO_LOD.init();
+    VBO_LOD.update(Eigen::MatrixXf(2,0));
+    VBO_LOD_C.init();
+    VBO_LOD_C.update(Eigen::MatrixXf(3,0));
+    program.bindVertexAttribArray("position", VBO_LOD);
+    program.bindVertexAttribArray("color", VBO_LOD_C);
+    VAO.bind();
 
-    // Loop until the user closes the window
-    while (!glfwWindowShouldClose(window))
-    {
-        // Bind your VAO (not necessary if you have only one)
-        VAO.bind();
+    // The selection rectangle or lasso only has positions, drawn with a constant color
+    VAO_BAND.init();
+    VAO_BAND.bind();
+    VBO_BAND.init();
+    selectionBand.resize(2,0);
+    VBO_BAND.update(selectionBand);
+    program.bindVertexAttribArray("position", VBO_BAND);
+    VAO.bind();
 
-        // Bind your program
-        program.bind();
+    // The indexed mesh has its own vertex pool and index buffer
+    VAO_MESH.init();
+    VAO_MESH.bind();
+    VBO_MESH.init();
+    VBO_MESH_C.init();
+    EBO_MESH.init();
+    uploadMesh();
+    program.bindVertexAttribArray("position", VBO_MESH);
+    program.bindVertexAttribArray("color", VBO_MESH_C);
+    VAO.bind();
 
-        // Clear the framebuffer
-        glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+    // The imported triangles are appended to the soup and uploaded at once
+    for(unsigned int i = 0; i < importPaths.size(); i++){
+        ImportStats stats;
+        if(importTriangles(importPaths[i], V, C, colorCode.col(10), &stats))
+            cout << "Imported " << stats.triangles << " triangles from " << importPaths[i] << ": " << stats.bytes / (1024.0 * 1024.0) << " MB in " << stats.ms << " ms, " << stats.megabytesPerSecond() << " MB/s, " << stats.skipped << " lines or faces skipped" << endl;
+    }
+    if(!importPaths.empty())
+        uploadVertices(0, V.cols());
+
+    if(!scenePath.empty() && sceneFile.open(scenePath)){
+        chunkCache.init(&sceneFile, size_t(budgetMB * 1024 * 1024));
+        cout << "Streaming " << sceneFile.chunks.size() << " chunks from " << scenePath << " within " << budgetMB << " MB" << endl;
+    }
+
+    // The regression replaces the interactive session
+    int exitCode = 0;
+    if(!regressionDirectory.empty()){
+        createDirectory(regressionDirectory);
+        exitCode = runRegression();
+    } else {
+        // Register the keyboard callback
+        glfwSetKeyCallback(window, key_callback);
 
-        processKeyframe();
-        drawOutput(program);
+        // Register the mouse callback
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
 
-        // Swap front and back buffers
-        glfwSwapBuffers(window);
+        // Register the cursor position callback
+        glfwSetCursorPosCallback(window, cursor_position_callback);
 
-        // Poll for and process events
-        glfwPollEvents();
+        // Register the callbacks invalidating the whole window
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetWindowRefreshCallback(window, window_refresh_callback);
+
+        // Hand the context over to the render thread
+        glfwGetWindowSize(window, &windowWidth, &windowHeight);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glfwMakeContextCurrent(NULL);
+        std::thread renderThread(renderLoop, window);
+
+        // Loop until the user closes the window, the events are only queued here
+        while (!glfwWindowShouldClose(window)){
+            glfwWaitEvents();
+            flushOverflowEvents();
+        }
+        overflowEvents.push_back(InputEvent(InputEvent::QUIT));
+        while(!flushOverflowEvents())
+            glfwWaitEvents();
+        renderThread.join();
+        finishExport();
     }
+    glfwMakeContextCurrent(window);
 
     // Deallocate opengl memory
-    program.free();
+    shaders.free();
+    pickIds.free();
+    oit.free();
+    msaa.free();
     VAO.free();
     VBO.free();
+    VBO_C.free();
+    VBO_A.free();
+    VBO_L.free();
+    VBO_VC.free();
+    EBO.free();
+    if(drawTimeQuery[0])
+        glDeleteQueries(drawTimeQueries, drawTimeQuery);
+    VAO_LOD.free();
+    VBO_LOD.free();
+    VAO_BAND.free();
+    VBO_BAND.free();
+    VBO_LOD_C.free();
+    chunkCache.free();
+    sceneFile.close();
+    VAO_MESH.free();
+    VBO_MESH.free();
+    VBO_MESH_C.free();
+    EBO_MESH.free();
 
     // Deallocate glfw internals
     glfwTerminate();
-    return 0;
+    return exitCode;
 }
@@ -2,6 +2,7 @@
 
 // OpenGL Helpers to reduce the clutter
 #include "Helpers.h"
+#include "Geometry.h"
 
 // GLFW is necessary to handle the OpenGL context
 #include <GLFW/glfw3.h>
@@ -54,29 +55,6 @@ float translation_y = 0.0;
 float pointer_x = 0.0;
 float pointer_y = 0.0;
 
-bool ptInTriangle(float px, float py, float v0x, float v0y, float v1x, float v1y, float v2x, float v2y) {
-    float dX = px-v2x;
-    float dY = py-v2y;
-    float dX21 = v2x-v1x;
-    float dY12 = v1y-v2y;
-    float D = dY12*(v0x-v2x) + dX21*(v0y-v2y);
-    float s = dY12*dX + dX21*dY;
-    float t = (v2y-v0y)*dX + (v0x-v2x)*dY;
-    if (D<0) return s<=0 && t<=0 && s+t>=D;
-    return s>=0 && t>=0 && s+t<=D;
-}
-
-void removeColumn(Eigen::MatrixXf& matrix, unsigned int colToRemove)
-{
-    unsigned int numRows = matrix.rows();
-    unsigned int numCols = matrix.cols()-1;
-    
-    if( colToRemove < numCols )
-        matrix.block(0,colToRemove,numRows,numCols-colToRemove) = matrix.rightCols(numCols-colToRemove);
-    
-    matrix.conservativeResize(numRows,numCols);
-}
-
 void cursor_position_callback(GLFWwindow *window, double x, double y)
 {
     if (enableCursorTrack)
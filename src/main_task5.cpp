@@ -2,6 +2,7 @@
 
 // OpenGL Helpers to reduce the clutter
 #include "Helpers.h"
+#include "Geometry.h"
 
 // GLFW is necessary to handle the OpenGL context
 #include <GLFW/glfw3.h>
@@ -17,8 +18,6 @@
 #include <string>
 using namespace std;
 
-#define PI 3.14159265
-
 // VertexBufferObject wrapper
 VertexBufferObject VBO;
 
@@ -80,74 +79,6 @@ Eigen::MatrixXf currentFrame(2,3);
 float interpolateInterval = 0.0;
 string animationtype;
 
-bool ptInTriangle(float px, float py, float v0x, float v0y, float v1x, float v1y, float v2x, float v2y) {
-    float dX = px-v2x;
-    float dY = py-v2y;
-    float dX21 = v2x-v1x;
-    float dY12 = v1y-v2y;
-    float D = dY12*(v0x-v2x) + dX21*(v0y-v2y);
-    float s = dY12*dX + dX21*dY;
-    float t = (v2y-v0y)*dX + (v0x-v2x)*dY;
-    if (D<0) return s<=0 && t<=0 && s+t>=D;
-    return s>=0 && t>=0 && s+t<=D;
-}
-
-void removeColumn(Eigen::MatrixXf& matrix, unsigned int colToRemove)
-{
-    unsigned int numRows = matrix.rows();
-    unsigned int numCols = matrix.cols()-1;
-    
-    if( colToRemove < numCols )
-        matrix.block(0,colToRemove,numRows,numCols-colToRemove) = matrix.rightCols(numCols-colToRemove);
-    
-    matrix.conservativeResize(numRows,numCols);
-}
-
-
-Eigen::Matrix4f rotate(double degree){
-    // Contains the rotation transformation
-    Eigen::Matrix4f rotation(4,4);
-    
-    rotation <<
-    cos(degree*PI/180), -sin(degree*PI/180), 0, 0,
-    sin(degree*PI/180), cos(degree*PI/180), 0, 0,
-    0, 0, 1, 0,
-    0, 0, 0, 1;
-    
-    return rotation;
-}
-
-Eigen::Matrix4f translate(float x, float y){
-    // Contains the translation transformation
-    Eigen::Matrix4f translate(4,4);
-    
-    translate <<
-    1, 0, 0, x,
-    0, 1, 0, y,
-    0, 0, 1, 0,
-    0, 0, 0, 1;
-    
-    return translate;
-}
-
-Eigen::Matrix4f scale(float zoom){
-    // Contains the rotation transformation
-    Eigen::Matrix4f scale(4,4);
-    
-    scale <<
-    zoom, 0, 0, 0,
-    0, zoom, 0, 0,
-    0, 0, 1, 0,
-    0, 0, 0, 1;
-    
-    return scale;
-}
-
-void centroid_of_triangle(float v0x, float v0y, float v1x, float v1y, float v2x, float v2y, float &px, float &py){
-    px = (v0x + v1x + v2x) / 3;
-    py = (v0y + v1y + v2y) / 3;
-}
-
 void updateChangesToSelectedObj(){
     if(selectedObjectIndex > -1){
         for(unsigned int i = 0; i < 3; i++){